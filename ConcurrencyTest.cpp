@@ -0,0 +1,270 @@
+#include "ReaderEpochs.h"
+#include "TestSupport.h"
+#include "VirtualMemory.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#define THREADS 4
+// pages every thread owns, together more than the RAM holds
+#define PAGES_PER_THREAD (NUM_FRAMES / 2)
+#define ROUNDS 10
+// threads alive at once in testManyThreads, more than there are epoch slots
+#define MANY_THREADS (2 * READER_EPOCH_SLOTS)
+#define MANY_THREAD_READS 200
+// accesses of every thread in testSharedPages
+#define SHARED_ACCESSES 20000
+
+static std::atomic<int> started{0};
+static std::atomic<int> finished{0};
+
+static uint64_t addressOf(int thread, uint64_t page) {
+    return ((uint64_t) thread * PAGES_PER_THREAD + page) * PAGE_SIZE;
+}
+
+static word_t valueOf(int thread, int round, uint64_t word) {
+    return (word_t) (thread * 1000000 + round * 10000 + word);
+}
+
+// starts the threads together and lets them interleave after every page,
+// even on a single core
+static void waitForThreads(std::atomic<int>& arrived, int threads) {
+    arrived++;
+    while (arrived < threads)
+        std::this_thread::yield();
+}
+
+/*
+ * Every thread writes its own pages word by word and with ranges, then
+ * reads them back with reads, ranges and gathers, while the other threads
+ * fault and evict the same frames.
+ */
+static void usePrivatePages(int thread) {
+    uint64_t words = PAGES_PER_THREAD * PAGE_SIZE;
+    std::vector<word_t> values(PAGE_SIZE);
+    std::vector<uint64_t> addresses(PAGE_SIZE);
+    waitForThreads(started, THREADS);
+    for (int round = 0; round < ROUNDS; round++) {
+        for (uint64_t page = 0; page < PAGES_PER_THREAD; page++) {
+            uint64_t base = addressOf(thread, page);
+            if (page % 2 == 0) {
+                for (uint64_t word = 0; word < PAGE_SIZE; word++)
+                    check(VMwrite(base + word, valueOf(thread, round, page * PAGE_SIZE + word)) == 1,
+                          "write");
+            } else {
+                for (uint64_t word = 0; word < PAGE_SIZE; word++)
+                    values[word] = valueOf(thread, round, page * PAGE_SIZE + word);
+                check(VMwriteRange(base, values.data(), PAGE_SIZE) == 1, "write a range");
+            }
+            std::this_thread::yield();
+        }
+        for (uint64_t word = 0; word < words; word++) {
+            word_t value = 0;
+            check(VMread(addressOf(thread, 0) + word, &value) == 1, "read");
+            check(value == valueOf(thread, round, word), "a thread reads its own values");
+        }
+        for (uint64_t page = 0; page < PAGES_PER_THREAD; page++) {
+            check(VMreadRange(addressOf(thread, page), values.data(), PAGE_SIZE) == 1,
+                  "read a range");
+            for (uint64_t word = 0; word < PAGE_SIZE; word++)
+                check(values[word] == valueOf(thread, round, page * PAGE_SIZE + word),
+                      "a range holds the thread's own values");
+            std::this_thread::yield();
+        }
+        // one word of every page, backwards
+        for (uint64_t i = 0; i < PAGE_SIZE; i++)
+            addresses[i] = addressOf(thread, (PAGES_PER_THREAD - 1 - i) % PAGES_PER_THREAD) + i;
+        check(VMgather(addresses.data(), values.data(), PAGE_SIZE) == 1, "gather");
+        for (uint64_t i = 0; i < PAGE_SIZE; i++)
+            check(values[i] == valueOf(thread, round, addresses[i] - addressOf(thread, 0)),
+                  "a gather holds the thread's own values");
+    }
+}
+
+static void testPrivatePages() {
+    VMinitialize();
+    started = 0;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < THREADS; thread++)
+        threads.emplace_back(usePrivatePages, thread);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+/*
+ * Every thread switches to a space of its own and uses the same addresses
+ * as the others, so a walk that read a table of another space would show.
+ */
+static void testThreadsInSpaces() {
+    VMinitialize();
+    space_t spaces[THREADS] = {DEFAULT_SPACE};
+    for (int i = 1; i < THREADS; i++)
+        check(VMcreateSpace(&spaces[i]) == 1, "create a space");
+
+    started = 0;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < THREADS; thread++) {
+        threads.emplace_back([thread, &spaces] {
+            check(VMswitchSpace(spaces[thread]) == 1, "switch to a space");
+            waitForThreads(started, THREADS);
+            for (int round = 0; round < ROUNDS; round++) {
+                for (uint64_t word = 0; word < PAGES_PER_THREAD * PAGE_SIZE; word++) {
+                    check(VMwrite(addressOf(0, 0) + word, valueOf(thread, round, word)) == 1,
+                          "write");
+                    if (word % PAGE_SIZE == PAGE_SIZE - 1)
+                        std::this_thread::yield();
+                }
+                for (uint64_t word = 0; word < PAGES_PER_THREAD * PAGE_SIZE; word++) {
+                    word_t value = 0;
+                    check(VMread(addressOf(0, 0) + word, &value) == 1, "read");
+                    check(value == valueOf(thread, round, word), "a space reads its own values");
+                    if (word % PAGE_SIZE == PAGE_SIZE - 1)
+                        std::this_thread::yield();
+                }
+                check(VMcurrentSpace() == spaces[thread], "a thread stays in its space");
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    check(VMcurrentSpace() == DEFAULT_SPACE, "switching spaces is private to a thread");
+}
+
+/*
+ * Keeps more threads alive than there are epoch slots, all of them reading
+ * before any exits, so a thread that kept its slot after leaving would
+ * block the rest for good.
+ */
+static void testManyThreads() {
+    VMinitialize();
+    uint64_t words = 2 * NUM_FRAMES * PAGE_SIZE;
+    for (uint64_t address = 0; address < words; address++)
+        VMwrite(address, (word_t) address);
+
+    started = 0;
+    finished = 0;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < MANY_THREADS; thread++) {
+        threads.emplace_back([thread, words] {
+            waitForThreads(started, MANY_THREADS);
+            for (uint64_t i = 0; i < MANY_THREAD_READS; i++) {
+                uint64_t address = (thread * 7919 + i * 104729) % words;
+                word_t value = 0;
+                check(VMread(address, &value) == 1, "read");
+                check(value == (word_t) address, "a read returns the value written");
+            }
+            waitForThreads(finished, MANY_THREADS);
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+static word_t sharedValueOf(uint64_t address) {
+    return (word_t) (address * 3);
+}
+
+/*
+ * Every thread reads and writes the same pages, more of them than the RAM
+ * holds, always writing the value an address started with. Any read that
+ * went through a stale translation of an evicted page would find a frame
+ * that holds another page and show a wrong value.
+ */
+static void testSharedPages() {
+    VMinitialize();
+    uint64_t words = 2 * NUM_FRAMES * PAGE_SIZE;
+    for (uint64_t address = 0; address < words; address++)
+        VMwrite(address, sharedValueOf(address));
+
+    started = 0;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < THREADS; thread++) {
+        threads.emplace_back([thread, words] {
+            std::vector<word_t> values(PAGE_SIZE);
+            uint64_t state = thread + 1;
+            waitForThreads(started, THREADS);
+            for (uint64_t i = 0; i < SHARED_ACCESSES; i++) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                uint64_t address = (state >> 33) % words;
+                word_t value = 0;
+                switch ((state >> 20) % 4) {
+                    case 0:
+                        check(VMwrite(address, sharedValueOf(address)) == 1, "write");
+                        break;
+                    case 1: {
+                        uint64_t base = address - address % PAGE_SIZE;
+                        check(VMreadRange(base, values.data(), PAGE_SIZE) == 1, "read a range");
+                        for (uint64_t word = 0; word < PAGE_SIZE; word++)
+                            check(values[word] == sharedValueOf(base + word),
+                                  "a range holds the values of its addresses");
+                        break;
+                    }
+                    default:
+                        // the same page again, most likely through the TLB
+                        for (int repeat = 0; repeat < 2; repeat++) {
+                            check(VMread(address, &value) == 1, "read");
+                            check(value == sharedValueOf(address),
+                                  "a read returns the value of its address");
+                        }
+                }
+                if (i % 64 == 0)
+                    std::this_thread::yield();
+            }
+            check(VMtlbHits() > 0, "a thread translates through its own TLB");
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    for (uint64_t address = 0; address < words; address++) {
+        word_t value = 0;
+        VMread(address, &value);
+        check(value == sharedValueOf(address), "the pages hold their values afterwards");
+    }
+}
+
+/*
+ * A thread sits in a space of its own while another thread calls
+ * VMinitialize, after which the space is gone and the thread must be back
+ * in the default space.
+ */
+static void testInitializeResetsOtherThreads() {
+    VMinitialize();
+    space_t space = DEFAULT_SPACE;
+    for (int i = 1; i < THREADS; i++)
+        check(VMcreateSpace(&space) == 1, "create a space");
+
+    std::atomic<int> step{0};
+    std::thread thread([space, &step] {
+        check(VMswitchSpace(space) == 1, "switch to a space");
+        for (uint64_t address = 0; address < NUM_FRAMES * PAGE_SIZE; address++)
+            check(VMwrite(address, (word_t) address) == 1, "write");
+        step = 1;
+        while (step < 2)
+            std::this_thread::yield();
+
+        check(VMcurrentSpace() == DEFAULT_SPACE, "VMinitialize moves every thread to the default space");
+        word_t value = 0;
+        check(VMread(0, &value) == 1 && value == 17, "a thread reads the default space after VMinitialize");
+        check(VMwrite(PAGE_SIZE, 23) == 1, "write");
+    });
+    while (step < 1)
+        std::this_thread::yield();
+    VMinitialize();
+    check(VMwrite(0, 17) == 1, "write");
+    step = 2;
+    thread.join();
+
+    word_t value = 0;
+    check(VMread(PAGE_SIZE, &value) == 1 && value == 23, "the thread wrote to the default space");
+}
+
+int main() {
+    testPrivatePages();
+    testThreadsInSpaces();
+    testManyThreads();
+    testSharedPages();
+    testInitializeResetsOtherThreads();
+    return testResult();
+}
@@ -0,0 +1,129 @@
+#include "FrameKernels.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS 1
+#else
+#define X86_KERNELS 0
+#endif
+
+/*****************************************************************************
+*                                 Scalar                                     *
+*****************************************************************************/
+
+static void zeroScalar(void* destination, size_t bytes) {
+    memset(destination, 0, bytes);
+}
+
+static bool isZeroScalar(const void* source, size_t bytes) {
+    const unsigned char* data = static_cast<const unsigned char*>(source);
+    unsigned char accumulated = 0;
+    for (size_t i = 0; i < bytes; i++)
+        accumulated |= data[i];
+    return accumulated == 0;
+}
+
+static void copyScalar(void* destination, const void* source, size_t bytes) {
+    memcpy(destination, source, bytes);
+}
+
+#if X86_KERNELS
+/*****************************************************************************
+*                                  SSE2                                      *
+*****************************************************************************/
+
+#define SSE2_BYTES 16
+
+__attribute__((target("sse2")))
+static void zeroSse2(void* destination, size_t bytes) {
+    char* data = static_cast<char*>(destination);
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + SSE2_BYTES <= bytes; i += SSE2_BYTES)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), zero);
+    zeroScalar(data + i, bytes - i);
+}
+
+__attribute__((target("sse2")))
+static bool isZeroSse2(const void* source, size_t bytes) {
+    const char* data = static_cast<const char*>(source);
+    __m128i accumulated = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + SSE2_BYTES <= bytes; i += SSE2_BYTES)
+        accumulated = _mm_or_si128(accumulated,
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+    __m128i equal = _mm_cmpeq_epi8(accumulated, _mm_setzero_si128());
+    return _mm_movemask_epi8(equal) == 0xFFFF && isZeroScalar(data + i, bytes - i);
+}
+
+__attribute__((target("sse2")))
+static void copySse2(void* destination, const void* source, size_t bytes) {
+    char* to = static_cast<char*>(destination);
+    const char* from = static_cast<const char*>(source);
+    size_t i = 0;
+    for (; i + SSE2_BYTES <= bytes; i += SSE2_BYTES)
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(to + i),
+                         _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i)));
+    copyScalar(to + i, from + i, bytes - i);
+}
+
+/*****************************************************************************
+*                                  AVX2                                      *
+*****************************************************************************/
+
+#define AVX2_BYTES 32
+
+__attribute__((target("avx2")))
+static void zeroAvx2(void* destination, size_t bytes) {
+    char* data = static_cast<char*>(destination);
+    __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + AVX2_BYTES <= bytes; i += AVX2_BYTES)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), zero);
+    zeroSse2(data + i, bytes - i);
+}
+
+__attribute__((target("avx2")))
+static bool isZeroAvx2(const void* source, size_t bytes) {
+    const char* data = static_cast<const char*>(source);
+    __m256i accumulated = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + AVX2_BYTES <= bytes; i += AVX2_BYTES)
+        accumulated = _mm256_or_si256(accumulated,
+                                      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+    return _mm256_testz_si256(accumulated, accumulated) && isZeroSse2(data + i, bytes - i);
+}
+
+__attribute__((target("avx2")))
+static void copyAvx2(void* destination, const void* source, size_t bytes) {
+    char* to = static_cast<char*>(destination);
+    const char* from = static_cast<const char*>(source);
+    size_t i = 0;
+    for (; i + AVX2_BYTES <= bytes; i += AVX2_BYTES)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(to + i),
+                            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(from + i)));
+    copySse2(to + i, from + i, bytes - i);
+}
+#endif
+
+/*****************************************************************************
+*                                Dispatch                                    *
+*****************************************************************************/
+
+static FrameKernels selectKernels() {
+#if X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {zeroAvx2, isZeroAvx2, copyAvx2};
+    if (__builtin_cpu_supports("sse2"))
+        return {zeroSse2, isZeroSse2, copySse2};
+#endif
+    return {zeroScalar, isZeroScalar, copyScalar};
+}
+
+const FrameKernels& frameKernels() {
+    static const FrameKernels kernels = selectKernels();
+    return kernels;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+ * Word block kernels used for whole frame operations. The fastest
+ * implementation the CPU supports (AVX2, SSE2 or plain scalar code) is
+ * picked the first time the kernels are requested.
+ * The kernels are plain memory accesses, so the concurrent build only uses
+ * them on frames no other thread can read at the same time.
+ */
+typedef struct {
+    void (*zero)(void* destination, size_t bytes);
+    bool (*isZero)(const void* source, size_t bytes);
+    void (*copy)(void* destination, const void* source, size_t bytes);
+} FrameKernels;
+
+const FrameKernels& frameKernels();
@@ -0,0 +1,64 @@
+#include "TestSupport.h"
+#include "VirtualMemory.h"
+
+#include <cstdio>
+#include <map>
+#include <random>
+
+#define SPACES 2
+#define ACCESSES 20000
+// pages of the dense part of the workload, more than the RAM holds
+#define DENSE_PAGES (4 * NUM_FRAMES)
+
+/*
+ * Runs the same workload in every build of the frame search and writes
+ * what it read and how many pages were evicted after every access to the
+ * trace file named on the command line. The searches must pick the same
+ * frames in the same order, so the traces of all builds must be equal.
+ * Half of the accesses are spread over the whole virtual memory, so tables
+ * are emptied and reused as well.
+ */
+static void traceWorkload(FILE* trace) {
+    VMinitialize();
+    space_t spaces[SPACES] = {DEFAULT_SPACE};
+    for (int i = 1; i < SPACES; i++)
+        check(VMcreateSpace(&spaces[i]) == 1, "create a space");
+
+    std::map<uint64_t, word_t> written[SPACES];
+    std::mt19937_64 random(11);
+    for (int access = 0; access < ACCESSES; access++) {
+        int space = (int) (random() % SPACES);
+        VMswitchSpace(spaces[space]);
+        uint64_t address = (random() % 2) ? random() % VIRTUAL_MEMORY_SIZE
+                                          : random() % (DENSE_PAGES * PAGE_SIZE);
+        word_t value = 0;
+        if (random() % 2) {
+            value = (word_t) (random() % 1000000);
+            check(VMwrite(address, value) == 1, "write");
+            written[space][address] = value;
+        } else {
+            check(VMread(address, &value) == 1, "read");
+            std::map<uint64_t, word_t>::iterator expected = written[space].find(address);
+            check(expected == written[space].end() || expected->second == value,
+                  "a read returns the last value written");
+        }
+        fprintf(trace, "%d %llu %lld %llu %llu\n", space, (unsigned long long) address,
+                (long long) value, (unsigned long long) VMspaceEvictions(spaces[0]),
+                (unsigned long long) VMspaceEvictions(spaces[1]));
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        printf("usage: %s trace-file\n", argv[0]);
+        return 1;
+    }
+    FILE* trace = fopen(argv[1], "w");
+    if (trace == nullptr) {
+        printf("cannot write %s\n", argv[1]);
+        return 1;
+    }
+    traceWorkload(trace);
+    fclose(trace);
+    return testResult();
+}
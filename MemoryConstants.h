@@ -3,23 +3,38 @@
 #include <climits>
 #include <stdint.h>
 
+// number of bits in a memory word, 64 allows large memories
+#ifndef WORD_BITS
+#define WORD_BITS 32
+#endif
+
+#if WORD_BITS == 64
+typedef int64_t word_t;
+#else
 typedef int word_t;
+#endif
 
 #define WORD_WIDTH (sizeof(word_t) * CHAR_BIT)
 
 // number of bits in the offset
+#ifndef OFFSET_WIDTH
 #define OFFSET_WIDTH 4
+#endif
 // page/frame size in words
 // in this implementation this is also the number of entries in a table
 #define PAGE_SIZE (1LL << OFFSET_WIDTH)
 
 // number of bits in a physical address
+#ifndef PHYSICAL_ADDRESS_WIDTH
 #define PHYSICAL_ADDRESS_WIDTH 10
+#endif
 // RAM size in words
 #define RAM_SIZE (1LL << PHYSICAL_ADDRESS_WIDTH)
 
 // number of bits in a virtual address
+#ifndef VIRTUAL_ADDRESS_WIDTH
 #define VIRTUAL_ADDRESS_WIDTH 20
+#endif
 // virtual memory size in words
 #define VIRTUAL_MEMORY_SIZE (1LL << VIRTUAL_ADDRESS_WIDTH)
 
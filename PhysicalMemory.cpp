@@ -1,72 +1,187 @@
 #include "PhysicalMemory.h"
-#include <vector>
-#include <unordered_map>
+#include "FrameKernels.h"
+#include "SwapStore.h"
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <sys/mman.h>
 
 
-typedef std::vector<word_t> page_t;
+#define FRAME_BYTES (PAGE_SIZE * sizeof(word_t))
 
 int evict_counter = 0;
 
-std::vector<page_t> RAM;
-std::unordered_map<uint64_t, page_t> swapFile;
+// all frames live in one contiguous page aligned mapping
+word_t* RAM = nullptr;
+SwapStore swapFile;
+#if CONCURRENT_VM
+// pages are discarded by readers while a fault evicts and restores others
+std::mutex swapMutex;
+#endif
 
-void initialize() {
-    RAM.resize(NUM_FRAMES, page_t(PAGE_SIZE));
+word_t* frameAddress(uint64_t frameIndex) {
+    return RAM + (frameIndex << OFFSET_WIDTH);
+}
+
+static std::once_flag ramMapped;
+
+bool PMinitialize() {
+    // anonymous memory starts zeroed and is only backed once touched,
+    // so large RAMs cost nothing until their frames are used
+    std::call_once(ramMapped, [] {
+        void* address = mmap(nullptr, RAM_SIZE * sizeof(word_t), PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (address != MAP_FAILED)
+            RAM = static_cast<word_t*>(address);
+    });
+    return RAM != nullptr;
 }
 
 void PMread(uint64_t physicalAddress, word_t* value) {
 
-    if (RAM.empty())
-        initialize();
+    assert(RAM != nullptr);
 
     assert(physicalAddress < RAM_SIZE);
 
-    *value = RAM[physicalAddress / PAGE_SIZE][physicalAddress
-             % PAGE_SIZE];
+#if CONCURRENT_VM
+    *value = __atomic_load_n(&RAM[physicalAddress], __ATOMIC_ACQUIRE);
+#else
+    *value = RAM[physicalAddress];
+#endif
 //    std::cout << "read " << *value << " from physical address " << physicalAddress << std::endl;
  }
 
 void PMwrite(uint64_t physicalAddress, word_t value) {
 //    std::cout << "write " << value << " into physical address " << physicalAddress<< std::endl;
-    if (RAM.empty())
-        initialize();
+    assert(RAM != nullptr);
 
     assert(physicalAddress < RAM_SIZE);
 
-    RAM[physicalAddress / PAGE_SIZE][physicalAddress
-             % PAGE_SIZE] = value;
+#if CONCURRENT_VM
+    __atomic_store_n(&RAM[physicalAddress], value, __ATOMIC_RELEASE);
+#else
+    RAM[physicalAddress] = value;
+#endif
+}
+
+bool PMcompareExchange(uint64_t physicalAddress, word_t* expected, word_t desired) {
+    assert(RAM != nullptr);
+
+    assert(physicalAddress < RAM_SIZE);
+
+    return __atomic_compare_exchange_n(&RAM[physicalAddress], expected, desired, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+void PMreadFrame(uint64_t frameIndex, word_t* words) {
+    assert(RAM != nullptr);
+
+    assert(frameIndex < NUM_FRAMES);
+
+#if CONCURRENT_VM
+    // tables are read while readers set flags in their entries, which the
+    // frame kernels are not atomic against
+    word_t* frame = frameAddress(frameIndex);
+    for (uint64_t i = 0; i < PAGE_SIZE; i++)
+        words[i] = __atomic_load_n(&frame[i], __ATOMIC_ACQUIRE);
+#else
+    frameKernels().copy(words, frameAddress(frameIndex), FRAME_BYTES);
+#endif
+}
+
+void PMwriteFrame(uint64_t frameIndex, const word_t* words) {
+    assert(RAM != nullptr);
+
+    assert(frameIndex < NUM_FRAMES);
+
+#if CONCURRENT_VM
+    // other threads may read and write the words of a page meanwhile
+    word_t* frame = frameAddress(frameIndex);
+    for (uint64_t i = 0; i < PAGE_SIZE; i++)
+        __atomic_store_n(&frame[i], words[i], __ATOMIC_RELEASE);
+#else
+    frameKernels().copy(frameAddress(frameIndex), words, FRAME_BYTES);
+#endif
+}
+
+void PMzeroFrame(uint64_t frameIndex) {
+    assert(RAM != nullptr);
+
+    assert(frameIndex < NUM_FRAMES);
+
+    frameKernels().zero(frameAddress(frameIndex), FRAME_BYTES);
+}
+
+bool PMisFrameZero(uint64_t frameIndex) {
+    assert(RAM != nullptr);
+
+    assert(frameIndex < NUM_FRAMES);
+
+#if CONCURRENT_VM
+    // a table may be tested while readers set flags in its entries
+    word_t* frame = frameAddress(frameIndex);
+    for (uint64_t i = 0; i < PAGE_SIZE; i++) {
+        if (__atomic_load_n(&frame[i], __ATOMIC_ACQUIRE) != 0)
+            return false;
+    }
+    return true;
+#else
+    return frameKernels().isZero(frameAddress(frameIndex), FRAME_BYTES);
+#endif
 }
 
 void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex) {
 //    std::cout << "evict " << evictedPageIndex << " from the frame " <<frameIndex<< std::endl;
-    if (RAM.empty())
-        initialize();
+    assert(RAM != nullptr);
+
+    assert(frameIndex < NUM_FRAMES);
+
+#if CONCURRENT_VM
+    std::lock_guard<std::mutex> lock(swapMutex);
+#endif
+    // a copy left over from an earlier restore is stale by now
+    swapFile.write(evictedPageIndex, frameAddress(frameIndex));
+    evict_counter++;
+}
+
+void PMevictClean(uint64_t frameIndex, uint64_t evictedPageIndex) {
+    assert(RAM != nullptr);
 
-    assert(swapFile.find(evictedPageIndex) == swapFile.end());
     assert(frameIndex < NUM_FRAMES);
-    assert(evictedPageIndex < NUM_PAGES);
 
-    swapFile[evictedPageIndex] = RAM[frameIndex];
+#if CONCURRENT_VM
+    std::lock_guard<std::mutex> lock(swapMutex);
+#endif
+    // the page was not modified, so the copy kept by PMrestore is still
+    // valid and the write back can be skipped
+    if (!swapFile.contains(evictedPageIndex))
+        swapFile.write(evictedPageIndex, frameAddress(frameIndex));
     evict_counter++;
 }
 
 void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex) {
 //    std::cout << "restore " << restoredPageIndex << " from the hard drive to the frame " << frameIndex << std::endl;
-    if (RAM.empty())
-        initialize();
+    assert(RAM != nullptr);
 
     assert(frameIndex < NUM_FRAMES);
 
-    // page is not in swap file, so this is essentially
-    // the first reference to this page. we can just return
-    // as it doesn't matter if the page contains garbage
-    if (swapFile.find(restoredPageIndex) == swapFile.end())
-        return;
+#if CONCURRENT_VM
+    std::lock_guard<std::mutex> lock(swapMutex);
+#endif
+    // if the page is not in swap file, this is essentially
+    // the first reference to this page, and it doesn't matter
+    // if the page contains garbage. otherwise the copy stays in
+    // the swap file so a clean page can be evicted without writing it back
+    swapFile.read(restoredPageIndex, frameAddress(frameIndex));
+}
 
-    RAM[frameIndex] = std::move(swapFile[restoredPageIndex]);
-    swapFile.erase(restoredPageIndex);
+void PMdiscard(uint64_t pageIndex) {
+#if CONCURRENT_VM
+    std::lock_guard<std::mutex> lock(swapMutex);
+#endif
+    swapFile.discard(pageIndex);
 }
 
 void printRam()
@@ -2,6 +2,20 @@
 
 #include "MemoryConstants.h"
 
+// lets the functions below be called from several threads at once. Words
+// are read and written atomically, but a frame must not be evicted,
+// restored or zeroed while other threads use it
+#ifndef CONCURRENT_VM
+#define CONCURRENT_VM 0
+#endif
+
+/*
+ * Maps the physical memory, which starts zeroed. Must return true before
+ * any other function is called, and does nothing after the first call.
+ * Returns false if the memory cannot be mapped.
+ */
+bool PMinitialize();
+
 /*
  * Reads an integer from the given physical address and puts it in 'value'.
  */
@@ -12,14 +26,57 @@ void PMread(uint64_t physicalAddress, word_t* value);
  */
 void PMwrite(uint64_t physicalAddress, word_t value);
 
+/*
+ * Replaces the word at the given physical address with 'desired' if it
+ * still equals '*expected', in one atomic step.
+ * Returns false and puts the current word in '*expected' otherwise.
+ */
+bool PMcompareExchange(uint64_t physicalAddress, word_t* expected, word_t desired);
+
+/*
+ * Copies the whole frame into 'words', which must hold PAGE_SIZE words.
+ */
+void PMreadFrame(uint64_t frameIndex, word_t* words);
+
+/*
+ * Overwrites the whole frame with the PAGE_SIZE words in 'words'.
+ */
+void PMwriteFrame(uint64_t frameIndex, const word_t* words);
+
+/*
+ * Sets every word of the frame to 0.
+ */
+void PMzeroFrame(uint64_t frameIndex);
+
+/*
+ * Returns true if every word of the frame is 0.
+ */
+bool PMisFrameZero(uint64_t frameIndex);
+
 
 /*
  * Evicts a page from the RAM to the hard drive.
+ * Page indices identify pages across all address spaces, so they may be
+ * larger than NUM_PAGES.
  */
 void PMevict(uint64_t frameIndex, uint64_t evictedPageIndex);
 
 
+/*
+ * Evicts a page that was not modified since it was restored from the hard
+ * drive. The copy already kept there is reused and only written if missing.
+ */
+void PMevictClean(uint64_t frameIndex, uint64_t evictedPageIndex);
+
+
 /*
  * Restores a page from the hard drive to the RAM.
  */
 void PMrestore(uint64_t frameIndex, uint64_t restoredPageIndex);
+
+
+/*
+ * Drops the hard drive copy of a page. Called once a restored page is
+ * modified, as the copy can no longer be reused by PMevictClean.
+ */
+void PMdiscard(uint64_t pageIndex);
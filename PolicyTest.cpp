@@ -0,0 +1,84 @@
+#include "ReplacementPolicy.h"
+#include "TestSupport.h"
+#include "VirtualMemory.h"
+
+#include <map>
+#include <random>
+
+// pages of the random workload, more than the RAM holds
+#define PAGES (4 * NUM_FRAMES)
+#define ACCESSES 20000
+
+static void testReadsBackUnderEvictions() {
+    VMinitialize();
+    std::map<uint64_t, word_t> written;
+    std::mt19937_64 random(7);
+    for (int access = 0; access < ACCESSES; access++) {
+        uint64_t address = random() % (PAGES * PAGE_SIZE);
+        if (random() % 2) {
+            word_t value = (word_t) (random() % 1000000);
+            check(VMwrite(address, value) == 1, "write");
+            written[address] = value;
+        } else {
+            word_t value = 0;
+            check(VMread(address, &value) == 1, "read");
+            std::map<uint64_t, word_t>::iterator expected = written.find(address);
+            check(expected == written.end() || expected->second == value,
+                  "a read returns the last value written");
+        }
+    }
+    check(VMspaceEvictions(DEFAULT_SPACE) > 0, "the workload evicts pages");
+}
+
+#if REPLACEMENT_POLICY != POLICY_CYCLIC_DISTANCE
+static uint64_t addressOf(uint64_t page) {
+    return page * PAGE_SIZE;
+}
+
+// whether the page was resident, found by reading it and counting faults
+static bool wasResident(uint64_t page) {
+    uint64_t faults = VMspacePageFaults(DEFAULT_SPACE);
+    word_t value = 0;
+    check(VMread(addressOf(page), &value) == 1, "read");
+    check(value == (word_t) page, "a read returns the value written");
+    return VMspacePageFaults(DEFAULT_SPACE) == faults;
+}
+
+/*
+ * Fills the RAM with pages 0, 1, 2... until the first eviction, which takes
+ * page 0 under every policy here, touches page 1 again and faults in one
+ * more page. LRU and CLOCK keep page 1 and take page 2, FIFO takes page 1.
+ */
+static void testEvictionOrder() {
+    VMinitialize();
+    uint64_t page = 0;
+    while (VMspaceEvictions(DEFAULT_SPACE) == 0) {
+        check(VMwrite(addressOf(page), (word_t) page) == 1, "write");
+        page++;
+    }
+    check(VMspaceEvictions(DEFAULT_SPACE) == 1, "the page that fills the RAM evicts one page");
+
+    word_t value = 0;
+    check(VMread(addressOf(1), &value) == 1, "read");
+    check(VMwrite(addressOf(page), (word_t) page) == 1, "write");
+    check(VMspaceEvictions(DEFAULT_SPACE) == 2, "a page in an existing table evicts one page");
+
+#if REPLACEMENT_POLICY == POLICY_FIFO
+    check(!wasResident(1), "FIFO evicts the oldest page even if it was just used");
+#elif REPLACEMENT_POLICY == POLICY_LRU
+    check(wasResident(1), "LRU keeps the page used last");
+    check(!wasResident(2), "LRU evicts the page used least recently");
+#elif REPLACEMENT_POLICY == POLICY_CLOCK
+    check(wasResident(1), "CLOCK gives the accessed page a second chance");
+    check(!wasResident(2), "CLOCK evicts the next page that was not accessed");
+#endif
+}
+#endif
+
+int main() {
+    testReadsBackUnderEvictions();
+#if REPLACEMENT_POLICY != POLICY_CYCLIC_DISTANCE
+    testEvictionOrder();
+#endif
+    return testResult();
+}
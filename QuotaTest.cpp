@@ -0,0 +1,82 @@
+#include "TestSupport.h"
+#include "VirtualMemory.h"
+
+#include <map>
+#include <random>
+
+#define SPACES 4
+#define ACCESSES 20000
+// pages every space accesses, few enough that the tables leave room to
+// reach the quotas
+#define REGION_PAGES (4 * NUM_FRAMES)
+
+/*
+ * Runs a random workload in which the last space is the noisy one, and
+ * checks after every access that no space went past its maximum and that
+ * no space at or below its minimum lost a page to another space.
+ */
+static void testQuotasHold(int scope) {
+    const uint64_t minPages[SPACES] = {6, 0, 4, 0};
+    const uint64_t maxPages[SPACES] = {10, 8, UNLIMITED_PAGES, UNLIMITED_PAGES};
+
+    VMinitialize();
+    space_t spaces[SPACES] = {DEFAULT_SPACE};
+    for (int i = 1; i < SPACES; i++)
+        check(VMcreateSpace(&spaces[i]) == 1, "create a space");
+    for (int i = 0; i < SPACES; i++)
+        check(VMsetSpaceQuota(spaces[i], minPages[i], maxPages[i]) == 1, "set a quota");
+    check(VMsetReplacementScope(scope) == 1, "set the replacement scope");
+    check(VMsetSpaceWeight(spaces[SPACES - 1], 3) == 1, "set a weight");
+
+    std::mt19937_64 random(5);
+    std::map<uint64_t, word_t> written[SPACES];
+    uint64_t evictions[SPACES];
+    uint64_t resident[SPACES];
+    for (int access = 0; access < ACCESSES && failures == 0; access++) {
+        int space = (random() % 10 < 6) ? SPACES - 1 : (int) (random() % SPACES);
+        VMswitchSpace(spaces[space]);
+        for (int i = 0; i < SPACES; i++) {
+            evictions[i] = VMspaceEvictions(spaces[i]);
+            resident[i] = VMspaceResidentPages(spaces[i]);
+        }
+
+        uint64_t address = random() % (REGION_PAGES * PAGE_SIZE);
+        if (random() % 2) {
+            word_t value = (word_t) (random() % 1000000);
+            check(VMwrite(address, value) == 1, "write");
+            written[space][address] = value;
+        } else {
+            word_t value = 0;
+            check(VMread(address, &value) == 1, "read");
+            std::map<uint64_t, word_t>::iterator expected = written[space].find(address);
+            check(expected == written[space].end() || expected->second == value,
+                  "a read returns the last value written");
+        }
+
+        for (int i = 0; i < SPACES; i++) {
+            check(VMspaceResidentPages(spaces[i]) <= maxPages[i], "a space stays within its maximum");
+            if (i != space && VMspaceEvictions(spaces[i]) != evictions[i])
+                check(resident[i] > minPages[i], "a space keeps its minimum when others fault");
+        }
+    }
+}
+
+static void testQuotaArguments() {
+    VMinitialize();
+    space_t space = DEFAULT_SPACE;
+    check(VMcreateSpace(&space) == 1, "create a space");
+    check(VMsetSpaceQuota(space, 0, 0) == 0, "the maximum must not be 0");
+    check(VMsetSpaceQuota(space, 5, 4) == 0, "the minimum must not exceed the maximum");
+    check(VMsetSpaceQuota(space, NUM_FRAMES, UNLIMITED_PAGES) == 0,
+          "the minimums must leave room for the tables");
+    check(VMsetSpaceQuota(space + 1, 0, 1) == 0, "the space must exist");
+    check(VMsetSpaceWeight(space, 0) == 0, "the weight must not be 0");
+    check(VMsetReplacementScope(FAIR_REPLACEMENT + 1) == 0, "the scope must be known");
+}
+
+int main() {
+    testQuotasHold(GLOBAL_REPLACEMENT);
+    testQuotasHold(FAIR_REPLACEMENT);
+    testQuotaArguments();
+    return testResult();
+}
@@ -0,0 +1,118 @@
+#include "TestSupport.h"
+#include "VirtualMemory.h"
+
+#include <vector>
+
+// words of the long range, more than the RAM holds so it evicts its own pages
+#define LONG_RANGE (3 * NUM_FRAMES * PAGE_SIZE + PAGE_SIZE / 2)
+// words before the end of the virtual memory that the rejected calls cover
+#define TAIL 5
+
+static word_t valueOf(uint64_t address) {
+    return (word_t) (address * 7 + 3);
+}
+
+// whether every word from address on holds valueOf(address) + offset
+static bool holds(uint64_t address, uint64_t count, word_t offset) {
+    for (uint64_t i = 0; i < count; i++) {
+        word_t value = 0;
+        if (VMread(address + i, &value) != 1 || value != valueOf(address + i) + offset)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Writes ranges that start and end in the middle of a page, across a few
+ * pages and across more pages than the RAM holds, and reads them back both
+ * word by word and as ranges.
+ */
+static void testUnalignedRanges() {
+    VMinitialize();
+    const uint64_t starts[] = {1, PAGE_SIZE - 1, 3 * PAGE_SIZE + PAGE_SIZE / 2};
+    const uint64_t counts[] = {2 * PAGE_SIZE, 2, LONG_RANGE};
+    for (int offset = 0; offset < 3; offset++) {
+        uint64_t start = starts[offset];
+        uint64_t count = counts[offset];
+        std::vector<word_t> values(count);
+        for (uint64_t i = 0; i < count; i++)
+            values[i] = valueOf(start + i) + offset;
+        check(VMwriteRange(start, values.data(), count) == 1, "write a range");
+        check(holds(start, count, offset), "a word read returns what the range wrote");
+
+        std::vector<word_t> read(count, -1);
+        check(VMreadRange(start, read.data(), count) == 1, "read a range");
+        check(read == values, "a range read returns what the range wrote");
+    }
+}
+
+/*
+ * Ranges and scatters that reach past the end of the virtual memory fail
+ * before writing anything, and reads that do fail as well.
+ */
+static void testOutOfRangeWritesNothing() {
+    VMinitialize();
+    const uint64_t tail = VIRTUAL_MEMORY_SIZE - TAIL;
+    for (uint64_t address = tail; address < VIRTUAL_MEMORY_SIZE; address++)
+        check(VMwrite(address, valueOf(address)) == 1, "write");
+
+    std::vector<word_t> values(2 * TAIL, -1);
+    check(VMwriteRange(tail, values.data(), 2 * TAIL) == 0, "a range past the end is rejected");
+    check(VMwriteRange(VIRTUAL_MEMORY_SIZE, values.data(), 1) == 0,
+          "a range starting at the end is rejected");
+    check(VMreadRange(tail, values.data(), 2 * TAIL) == 0, "a range read past the end is rejected");
+
+    const uint64_t addresses[] = {tail, tail + 1, VIRTUAL_MEMORY_SIZE, tail + 2};
+    check(VMscatter(addresses, values.data(), 4) == 0, "a scatter past the end is rejected");
+    check(VMgather(addresses, values.data(), 4) == 0, "a gather past the end is rejected");
+
+    check(holds(tail, TAIL, 0), "a rejected call writes nothing");
+}
+
+/*
+ * Gathers addresses in no particular order from pages that are mapped and
+ * pages that were evicted, each into the position it was asked for.
+ */
+static void testGatherUnaligned() {
+    VMinitialize();
+    const uint64_t words = 2 * NUM_FRAMES * PAGE_SIZE;
+    for (uint64_t address = 0; address < words; address++)
+        check(VMwrite(address, valueOf(address)) == 1, "write");
+
+    const uint64_t addresses[] = {words - 1, 1, PAGE_SIZE + 3, 2, words / 2 + 5, PAGE_SIZE - 1, 1};
+    const uint64_t count = sizeof(addresses) / sizeof(addresses[0]);
+    word_t values[count];
+    check(VMgather(addresses, values, count) == 1, "gather");
+    for (uint64_t i = 0; i < count; i++)
+        check(values[i] == valueOf(addresses[i]), "a gather returns the word at its address");
+}
+
+/*
+ * Scatters several writes to the same addresses, interleaved with writes to
+ * other pages, so grouping them by page must keep their order and the last
+ * write to an address wins.
+ */
+static void testScatterKeepsOrder() {
+    VMinitialize();
+    const uint64_t first = PAGE_SIZE + 2;
+    const uint64_t second = 5 * PAGE_SIZE + 1;
+    const uint64_t other = 3 * PAGE_SIZE;
+    const uint64_t addresses[] = {second, first, other, first, second, first, other + 1, second};
+    const word_t values[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    const uint64_t count = sizeof(addresses) / sizeof(addresses[0]);
+    check(VMscatter(addresses, values, count) == 1, "scatter");
+
+    word_t value = 0;
+    check(VMread(first, &value) == 1 && value == 6, "the last write to an address wins");
+    check(VMread(second, &value) == 1 && value == 8, "the last write to an address wins");
+    check(VMread(other, &value) == 1 && value == 3, "a scatter writes every address");
+    check(VMread(other + 1, &value) == 1 && value == 7, "a scatter writes every address");
+}
+
+int main() {
+    testUnalignedRanges();
+    testOutOfRangeWritesNothing();
+    testGatherUnaligned();
+    testScatterKeepsOrder();
+    return testResult();
+}
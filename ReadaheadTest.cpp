@@ -0,0 +1,78 @@
+#include "TestSupport.h"
+#include "VirtualMemory.h"
+
+// pages scanned, more than the RAM holds so every pass runs on full memory
+#define PAGES (4 * NUM_FRAMES)
+#define PASSES 2
+#define SPACES 2
+
+static word_t valueOf(uint64_t address) {
+    return (word_t) (address * 5 + 2);
+}
+
+/*
+ * Scans memory that is already full front to back, so every page of the
+ * scan either is mapped ahead or faults, and a readahead that gave up on
+ * full memory would fault on every page.
+ */
+static void testSequentialScanOnFullMemory() {
+    VMinitialize();
+    for (uint64_t address = 0; address < PAGES * PAGE_SIZE; address++)
+        check(VMwrite(address, valueOf(address)) == 1, "write");
+
+    uint64_t faults = VMspacePageFaults(DEFAULT_SPACE);
+    uint64_t useful = VMreadaheadUseful();
+    for (int pass = 0; pass < PASSES; pass++) {
+        for (uint64_t address = 0; address < PAGES * PAGE_SIZE; address++) {
+            word_t value = 0;
+            check(VMread(address, &value) == 1, "read");
+            check(value == valueOf(address), "a read returns the value written");
+        }
+    }
+    faults = VMspacePageFaults(DEFAULT_SPACE) - faults;
+    useful = VMreadaheadUseful() - useful;
+
+    check(faults < PASSES * PAGES / 4, "most pages of the scan are mapped ahead");
+    check(faults + useful >= PASSES * PAGES, "every page of the scan faulted or was mapped ahead");
+    check(VMreadaheadUseful() <= VMreadaheadIssued(), "only pages mapped ahead are counted as useful");
+}
+
+/*
+ * Spaces take turns scanning the same pages of their own, so every fault
+ * of a space follows one of the other. Each space must keep its own stream
+ * to be read ahead at all.
+ */
+static void testSpacesScanInTurn() {
+    VMinitialize();
+    space_t spaces[SPACES] = {DEFAULT_SPACE};
+    for (int i = 1; i < SPACES; i++)
+        check(VMcreateSpace(&spaces[i]) == 1, "create a space");
+    for (int i = 0; i < SPACES; i++) {
+        VMswitchSpace(spaces[i]);
+        for (uint64_t address = 0; address < PAGES * PAGE_SIZE; address++)
+            check(VMwrite(address, valueOf(address) + spaces[i]) == 1, "write");
+    }
+
+    uint64_t faults[SPACES];
+    for (int i = 0; i < SPACES; i++)
+        faults[i] = VMspacePageFaults(spaces[i]);
+    for (uint64_t page = 0; page < PAGES; page++) {
+        for (int i = 0; i < SPACES; i++) {
+            VMswitchSpace(spaces[i]);
+            for (uint64_t address = page * PAGE_SIZE; address < (page + 1) * PAGE_SIZE; address++) {
+                word_t value = 0;
+                check(VMread(address, &value) == 1, "read");
+                check(value == valueOf(address) + spaces[i], "a read returns the value written");
+            }
+        }
+    }
+    for (int i = 0; i < SPACES; i++)
+        check(VMspacePageFaults(spaces[i]) - faults[i] < PAGES / 4,
+              "most pages of the scan of every space are mapped ahead");
+}
+
+int main() {
+    testSequentialScanOnFullMemory();
+    testSpacesScanInTurn();
+    return testResult();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+// number of threads that may be between enter and leave at once, any
+// further thread waits in enter until one of them leaves
+#define READER_EPOCH_SLOTS 64
+#define CACHE_LINE_BYTES 64
+
+/*
+ * Epoch based reclamation of frames taken out of the page tables.
+ * Readers walk the tables without locking, each publishing the epoch it
+ * entered in on its own cache line. A writer that unlinked a frame starts a
+ * new epoch and waits for every reader of an older one to leave, after
+ * which no walk can reach the frame and it may be reused.
+ * A reader holds a slot only between enter and leave, so any number of
+ * threads may use the epochs over time. Each thread starts its search at
+ * the slot it had last, which is usually still free.
+ */
+class ReaderEpochs
+{
+ public:
+  void enter ()
+  {
+    uint64_t &slot = ownSlot ();
+    while (true)
+    {
+      uint64_t epoch = current_epoch.load (std::memory_order_seq_cst);
+      for (uint64_t tried = 0; tried < READER_EPOCH_SLOTS; tried++)
+      {
+        uint64_t idle = IDLE;
+        if (slots[slot].epoch.compare_exchange_strong (
+            idle, epoch, std::memory_order_seq_cst,
+            std::memory_order_relaxed))
+        {
+          return;
+        }
+        slot = (slot + 1) % READER_EPOCH_SLOTS;
+      }
+      //Readers leave without waiting for anything, so one frees up soon
+      std::this_thread::yield ();
+    }
+  }
+
+  void leave ()
+  {
+    slots[ownSlot ()].epoch.store (IDLE, std::memory_order_release);
+  }
+
+  //Must not be called between enter and leave of the same thread
+  void waitForReaders ()
+  {
+    uint64_t epoch = current_epoch.fetch_add (1, std::memory_order_seq_cst)
+                     + 1;
+    for (uint64_t slot = 0; slot < READER_EPOCH_SLOTS; slot++)
+    {
+      while (true)
+      {
+        uint64_t seen = slots[slot].epoch.load (std::memory_order_seq_cst);
+        if (seen == IDLE || seen >= epoch)
+        {
+          break;
+        }
+        std::this_thread::yield ();
+      }
+    }
+  }
+
+ private:
+  static const uint64_t IDLE = 0;
+
+  struct alignas (CACHE_LINE_BYTES) ReaderSlot
+  {
+      std::atomic<uint64_t> epoch{IDLE};
+  };
+
+  //Slot the thread holds while inside, or last held. Threads start spread
+  //over the slots.
+  uint64_t &ownSlot ()
+  {
+    thread_local uint64_t slot =
+        next_start.fetch_add (1, std::memory_order_relaxed)
+        % READER_EPOCH_SLOTS;
+    return slot;
+  }
+
+  ReaderSlot slots[READER_EPOCH_SLOTS];
+  alignas (CACHE_LINE_BYTES) std::atomic<uint64_t> current_epoch{1};
+  std::atomic<uint64_t> next_start{0};
+};
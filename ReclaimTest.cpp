@@ -0,0 +1,81 @@
+#include "TestSupport.h"
+#include "VirtualMemory.h"
+
+#include <chrono>
+#include <thread>
+
+// pages written, more than the RAM holds
+#define PAGES (2 * NUM_FRAMES)
+// how long the reclaimer may take to refill the pool
+#define REFILL_TIMEOUT std::chrono::seconds(10)
+// time given to a reclaimer that should be idle to show that it is not
+#define SETTLE_TIME std::chrono::milliseconds(50)
+
+static word_t valueOf(uint64_t address) {
+    return (word_t) (address * 7 + 1);
+}
+
+/*
+ * Waits for the pool to hold at least the given number of frames, checking
+ * on the way that it never goes past the high watermark. Returns whether
+ * it got there in time.
+ */
+static bool waitForFreeFrames(uint64_t frames) {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + REFILL_TIMEOUT;
+    while (std::chrono::steady_clock::now() < deadline) {
+        uint64_t free = VMfreeFrames();
+        check(free <= RECLAIM_HIGH_WATERMARK, "the pool stays within the high watermark");
+        if (free >= frames)
+            return true;
+        std::this_thread::yield();
+    }
+    return false;
+}
+
+static void checkValues(uint64_t pages) {
+    for (uint64_t address = 0; address < pages * PAGE_SIZE; address++) {
+        word_t value = 0;
+        check(VMread(address, &value) == 1, "read");
+        check(value == valueOf(address), "a read returns the value written");
+    }
+}
+
+static void checkPoolIsFull() {
+    check(waitForFreeFrames(RECLAIM_HIGH_WATERMARK), "the pool fills up to the high watermark");
+    std::this_thread::sleep_for(SETTLE_TIME);
+    check(VMfreeFrames() == RECLAIM_HIGH_WATERMARK, "the pool stops at the high watermark");
+}
+
+static void testNoReclaimBeforeMemoryRunsOut() {
+    VMinitialize();
+    for (uint64_t address = 0; address < PAGE_SIZE; address++)
+        check(VMwrite(address, valueOf(address)) == 1, "write");
+    std::this_thread::sleep_for(SETTLE_TIME);
+    check(VMfreeFrames() == 0, "nothing is reclaimed while frames are unused");
+}
+
+static void testPoolStaysBetweenWatermarks() {
+    VMinitialize();
+    for (uint64_t address = 0; address < PAGES * PAGE_SIZE; address++)
+        check(VMwrite(address, valueOf(address)) == 1, "write");
+    checkPoolIsFull();
+
+    // every read of an evicted page takes a frame from the pool, and the
+    // faults stop as soon as it runs below the low watermark, so only
+    // crossing the watermark can start the refill
+    for (uint64_t page = 0; page < PAGES && VMfreeFrames() >= RECLAIM_LOW_WATERMARK; page++) {
+        word_t value = 0;
+        check(VMread(page * PAGE_SIZE, &value) == 1, "read");
+        check(value == valueOf(page * PAGE_SIZE), "a read returns the value written");
+    }
+    checkPoolIsFull();
+
+    checkValues(PAGES);
+    checkPoolIsFull();
+}
+
+int main() {
+    testNoReclaimBeforeMemoryRunsOut();
+    testPoolStaysBetweenWatermarks();
+    return testResult();
+}
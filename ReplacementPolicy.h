@@ -0,0 +1,345 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#define POLICY_CYCLIC_DISTANCE 0
+#define POLICY_LRU 1
+#define POLICY_FIFO 2
+#define POLICY_CLOCK 3
+
+// page replacement policy used by Priority 3, chosen at compile time
+#ifndef REPLACEMENT_POLICY
+#define REPLACEMENT_POLICY POLICY_CYCLIC_DISTANCE
+#endif
+
+/*
+ * Pages of all address spaces are identified by a key holding the space
+ * above the page number. The key of a page is its path from the root of its
+ * space, so ordering keys orders pages like a walk over the spaces in turn.
+ */
+#define SPACE_KEY_SHIFT (OFFSET_WIDTH * TABLES_DEPTH)
+#define SPACE_KEY_MASK (((uint64_t) 1 << SPACE_KEY_SHIFT) - 1)
+
+inline uint64_t pageKey (uint64_t space, uint64_t page)
+{
+  return (space << SPACE_KEY_SHIFT) | page;
+}
+
+inline uint64_t keySpace (uint64_t key)
+{
+  return key >> SPACE_KEY_SHIFT;
+}
+
+inline uint64_t keyPage (uint64_t key)
+{
+  return key & SPACE_KEY_MASK;
+}
+
+/*
+ * A resident page and the physical address of the leaf table entry mapping
+ * it. The entry of a page stays in place for as long as the page is
+ * resident, as a table holding a page is never reclaimed.
+ */
+typedef struct
+{
+    uint64_t page;
+    uint64_t pte_address;
+} ResidentPage;
+
+/*
+ * Every policy tracks the resident pages through the same hooks:
+ * onFault when a page is mapped into a frame, onAccess on every translation
+ * of a resident page and onEvict when a page is swapped out.
+ * selectVictim returns the resident page to swap out in favor of
+ * swap_in_page, taking only pages whose space passes the evictable
+ * predicate. It is only called while such a page is resident. Policies
+ * that sample the accessed bit of the pages instead of tracking accesses
+ * call test_and_clear_accessed, which clears the bit of a resident page and
+ * returns whether it was set.
+ * TRACKS_ACCESS tells whether onAccess changes the policy state.
+ */
+
+inline uint64_t calculateCyclicalDistance (uint64_t swap_in_page,
+                                           uint64_t page)
+{
+  uint64_t distance = (swap_in_page > page) ? (swap_in_page - page) : (page
+                                                                       - swap_in_page);
+  uint64_t cyclic = NUM_PAGES - distance;
+  return (cyclic < distance) ? cyclic : distance;
+}
+
+/*
+ * Evicts the page with the maximal cyclic distance from the page being
+ * swapped in, preferring the lower page on ties. Distances are measured
+ * between page numbers, whatever space the pages belong to.
+ */
+class CyclicDistancePolicy
+{
+ public:
+  static const bool TRACKS_ACCESS = false;
+
+  void reset ()
+  {
+    resident.clear ();
+  }
+
+  void onAccess (uint64_t)
+  {}
+
+  void onFault (uint64_t page, uint64_t pte_address)
+  {
+    resident[page] = pte_address;
+  }
+
+  void onEvict (uint64_t page)
+  {
+    resident.erase (page);
+  }
+
+  /*
+   * Takes the farthest page of every evictable space holding resident
+   * pages, and the farthest of those, preferring the lower space on ties.
+   */
+  template <typename Evictable, typename AccessTest>
+  ResidentPage selectVictim (uint64_t swap_in_key, Evictable evictable,
+                             AccessTest)
+  {
+    uint64_t swap_in_page = keyPage (swap_in_key);
+    bool found = false;
+    ResidentPage victim = {};
+    uint64_t victim_distance = 0;
+    Pages::iterator first = resident.begin ();
+    while (first != resident.end ())
+    {
+      Pages::iterator last =
+          resident.lower_bound (pageKey (keySpace (first->first) + 1, 0));
+      if (evictable (keySpace (first->first)))
+      {
+        ResidentPage candidate = selectInSpace (swap_in_page, first, last);
+        uint64_t distance =
+            calculateCyclicalDistance (swap_in_page, keyPage (candidate.page));
+        if (!found || distance > victim_distance)
+        {
+          found = true;
+          victim = candidate;
+          victim_distance = distance;
+        }
+      }
+      first = last;
+    }
+    return victim;
+  }
+
+ private:
+  /*
+   * The farthest page of the space holding [first, last) is the resident
+   * page closest to swap_in_page + NUM_PAGES / 2 on the ring, so only the
+   * neighbours of that point need to be compared.
+   */
+  typedef std::map<uint64_t, uint64_t> Pages;
+
+  ResidentPage selectInSpace (uint64_t swap_in_page, Pages::iterator first,
+                              Pages::iterator last)
+  {
+    uint64_t farthest_page = (swap_in_page + NUM_PAGES / 2) % NUM_PAGES;
+    Pages::iterator successor =
+        resident.lower_bound (pageKey (keySpace (first->first), farthest_page));
+    Pages::iterator predecessor = successor;
+    if (successor == last)
+    {
+      successor = first;
+    }
+    if (predecessor == first)
+    {
+      predecessor = last;
+    }
+    predecessor--;
+
+    uint64_t successor_distance =
+        calculateCyclicalDistance (swap_in_page, keyPage (successor->first));
+    uint64_t predecessor_distance =
+        calculateCyclicalDistance (swap_in_page, keyPage (predecessor->first));
+    Pages::iterator farthest = predecessor;
+    if (successor_distance != predecessor_distance)
+    {
+      farthest = (successor_distance > predecessor_distance) ? successor
+                                                             : predecessor;
+    }
+    else if (successor->first < predecessor->first)
+    {
+      farthest = successor;
+    }
+    return {farthest->first, farthest->second};
+  }
+
+  //Resident pages and their entries, ordered by key
+  Pages resident;
+};
+
+/*
+ * Evicts the page at the head of a queue ordered by fault time.
+ * With PROMOTE_ON_ACCESS every access moves the page to the tail, which
+ * turns FIFO into LRU.
+ */
+template <bool PROMOTE_ON_ACCESS>
+class QueuePolicy
+{
+ public:
+  static const bool TRACKS_ACCESS = PROMOTE_ON_ACCESS;
+
+  void reset ()
+  {
+    queue.clear ();
+    positions.clear ();
+  }
+
+  void onAccess (uint64_t page)
+  {
+    if (PROMOTE_ON_ACCESS)
+    {
+      Positions::iterator position = positions.find (page);
+      if (position != positions.end ())
+      {
+        queue.splice (queue.end (), queue, position->second);
+      }
+    }
+  }
+
+  void onFault (uint64_t page, uint64_t pte_address)
+  {
+    positions[page] = queue.insert (queue.end (), {page, pte_address});
+  }
+
+  void onEvict (uint64_t page)
+  {
+    Positions::iterator position = positions.find (page);
+    if (position != positions.end ())
+    {
+      queue.erase (position->second);
+      positions.erase (position);
+    }
+  }
+
+  template <typename Evictable, typename AccessTest>
+  ResidentPage selectVictim (uint64_t, Evictable evictable, AccessTest)
+  {
+    std::list<ResidentPage>::iterator page = queue.begin ();
+    while (!evictable (keySpace (page->page)))
+    {
+      page++;
+    }
+    return *page;
+  }
+
+ private:
+  typedef std::unordered_map<uint64_t, std::list<ResidentPage>::iterator>
+      Positions;
+
+  std::list<ResidentPage> queue;
+  Positions positions;
+};
+
+typedef QueuePolicy<true> LruPolicy;
+typedef QueuePolicy<false> FifoPolicy;
+
+/*
+ * Second chance: the hand sweeps over the resident pages, clearing their
+ * accessed bits, and evicts the first page that was not accessed since the
+ * previous sweep. The bits are set by the translations themselves, so
+ * accesses do not touch the policy.
+ */
+class ClockPolicy
+{
+ public:
+  static const bool TRACKS_ACCESS = false;
+
+  void reset ()
+  {
+    slots.clear ();
+    free_slots.clear ();
+    positions.clear ();
+    hand = 0;
+  }
+
+  void onAccess (uint64_t)
+  {}
+
+  void onFault (uint64_t page, uint64_t pte_address)
+  {
+    uint64_t slot = slots.size ();
+    if (free_slots.empty ())
+    {
+      slots.push_back ({});
+    }
+    else
+    {
+      slot = free_slots.back ();
+      free_slots.pop_back ();
+    }
+    slots[slot] = {{page, pte_address}, true};
+    positions[page] = slot;
+  }
+
+  void onEvict (uint64_t page)
+  {
+    std::unordered_map<uint64_t, uint64_t>::iterator position =
+        positions.find (page);
+    if (position != positions.end ())
+    {
+      slots[position->second].used = false;
+      free_slots.push_back (position->second);
+      positions.erase (position);
+    }
+  }
+
+  /*
+   * Pages of other spaces are passed over without losing their bit.
+   * Accesses running next to the sweep may set the bits again, so after
+   * two full turns the hand takes the next page it may evict.
+   */
+  template <typename Evictable, typename AccessTest>
+  ResidentPage selectVictim (uint64_t, Evictable evictable,
+                             AccessTest test_and_clear_accessed)
+  {
+    for (uint64_t step = 0;; step++)
+    {
+      ClockSlot &slot = slots[hand];
+      hand = (hand + 1) % slots.size ();
+      if (!slot.used || !evictable (keySpace (slot.resident.page)))
+      {
+        continue;
+      }
+      if (step >= 2 * slots.size ()
+          || !test_and_clear_accessed (slot.resident))
+      {
+        return slot.resident;
+      }
+    }
+  }
+
+ private:
+  typedef struct
+  {
+      ResidentPage resident;
+      bool used;
+  } ClockSlot;
+
+  std::vector<ClockSlot> slots;
+  std::vector<uint64_t> free_slots;
+  std::unordered_map<uint64_t, uint64_t> positions;
+  uint64_t hand = 0;
+};
+
+#if REPLACEMENT_POLICY == POLICY_LRU
+typedef LruPolicy ReplacementPolicy;
+#elif REPLACEMENT_POLICY == POLICY_FIFO
+typedef FifoPolicy ReplacementPolicy;
+#elif REPLACEMENT_POLICY == POLICY_CLOCK
+typedef ClockPolicy ReplacementPolicy;
+#else
+typedef CyclicDistancePolicy ReplacementPolicy;
+#endif
@@ -13,7 +13,7 @@ int main(int argc, char **argv) {
     for (uint64_t i = 0; i < (2 * NUM_FRAMES); ++i) {
         word_t value;
         VMread(5 * i * PAGE_SIZE, &value);
-        printf("reading from %llu %d\n", (long long int) i, value);
+        printf("reading from %llu %lld\n", (long long int) i, (long long int) value);
         assert(uint64_t(value) == i);
     }
     printf("success\n");
@@ -0,0 +1,73 @@
+#include "TestSupport.h"
+#include "VirtualMemory.h"
+
+// pages written in every space, together more than the RAM holds
+#define PAGES_PER_SPACE (NUM_FRAMES)
+#define SPACES 4
+
+static word_t valueOf(space_t space, uint64_t page) {
+    return (word_t) (space * 100000 + page);
+}
+
+static uint64_t addressOf(uint64_t page) {
+    // spread over the whole virtual memory so every space has many tables
+    return (page * (NUM_PAGES / PAGES_PER_SPACE)) * PAGE_SIZE + page % PAGE_SIZE;
+}
+
+static void testSpacesAreIsolated() {
+    VMinitialize();
+    space_t spaces[SPACES] = {DEFAULT_SPACE};
+    for (int i = 1; i < SPACES; i++)
+        check(VMcreateSpace(&spaces[i]) == 1, "create a space");
+
+    // the same addresses in every space, interleaved so spaces evict each other
+    for (uint64_t page = 0; page < PAGES_PER_SPACE; page++) {
+        for (int i = 0; i < SPACES; i++) {
+            check(VMswitchSpace(spaces[i]) == 1, "switch to a space");
+            check(VMcurrentSpace() == spaces[i], "current space follows the switch");
+            check(VMwrite(addressOf(page), valueOf(spaces[i], page)) == 1, "write");
+        }
+    }
+    for (int i = SPACES - 1; i >= 0; i--) {
+        VMswitchSpace(spaces[i]);
+        for (uint64_t page = 0; page < PAGES_PER_SPACE; page++) {
+            word_t value = 0;
+            check(VMread(addressOf(page), &value) == 1, "read");
+            check(value == valueOf(spaces[i], page), "a space reads its own values");
+        }
+    }
+
+    uint64_t resident = 0;
+    for (int i = 0; i < SPACES; i++) {
+        check(VMspacePageFaults(spaces[i]) >= PAGES_PER_SPACE, "every space faulted");
+        check(VMspaceEvictions(spaces[i]) > 0, "every space was evicted from");
+        resident += VMspaceResidentPages(spaces[i]);
+    }
+    check(resident < NUM_FRAMES, "resident pages fit in the RAM");
+}
+
+static void testSpaceHandles() {
+    VMinitialize();
+    check(VMcurrentSpace() == DEFAULT_SPACE, "VMinitialize switches to the default space");
+    check(VMswitchSpace(1) == 0, "no space exists before it is created");
+    check(VMcreateSpace(nullptr) == 0, "a space needs a handle");
+
+    space_t space = DEFAULT_SPACE;
+    int created = 1;
+    while (VMcreateSpace(&space) == 1)
+        created++;
+    check(created > 1, "spaces can be created");
+    check(VMswitchSpace(space) == 1, "the last space exists");
+    check(VMswitchSpace(space + 1) == 0, "spaces past the last do not exist");
+
+    // VMinitialize drops every space but the default one
+    VMinitialize();
+    check(VMswitchSpace(space) == 0, "spaces do not survive VMinitialize");
+    check(VMswitchSpace(DEFAULT_SPACE) == 1, "the default space survives VMinitialize");
+}
+
+int main() {
+    testSpacesAreIsolated();
+    testSpaceHandles();
+    return testResult();
+}
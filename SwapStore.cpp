@@ -0,0 +1,269 @@
+#include "SwapStore.h"
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define FRAME_BYTES (PAGE_SIZE * sizeof(word_t))
+#define EMPTY_KEY UINT64_MAX
+#define INITIAL_INDEX_CAPACITY 64
+#define BITMAP_WORD_BITS 64
+
+static_assert(SWAP_SLAB_SLOTS % BITMAP_WORD_BITS == 0,
+              "the slot table grows by whole bitmap words");
+
+/*
+ * The swap device cannot lose pages, so failing to access it is fatal.
+ */
+static void swapFailure(const char* operation) {
+    perror(operation);
+    abort();
+}
+
+/*****************************************************************************
+*                              Swap Slot Table                               *
+*****************************************************************************/
+
+SwapSlotTable::SwapSlotTable() {
+    growIndex();
+}
+
+uint64_t SwapSlotTable::capacity() const {
+    return freeSlots.size() * BITMAP_WORD_BITS;
+}
+
+uint64_t SwapSlotTable::allocateSlot() {
+    uint64_t words = freeSlots.size();
+    uint64_t firstWord = words == 0 ? 0 : (nextSlot / BITMAP_WORD_BITS) % words;
+    // the first word is visited twice: from nextSlot on, then below it
+    for (uint64_t scanned = 0; words != 0 && scanned <= words; scanned++) {
+        uint64_t word = (firstWord + scanned) % words;
+        uint64_t bits = freeSlots[word];
+        if (scanned == 0 && nextSlot / BITMAP_WORD_BITS == word)
+            bits &= ~0ULL << (nextSlot % BITMAP_WORD_BITS);
+        if (bits != 0) {
+            uint64_t slot = word * BITMAP_WORD_BITS + __builtin_ctzll(bits);
+            freeSlots[word] &= ~(1ULL << (slot % BITMAP_WORD_BITS));
+            nextSlot = slot + 1;
+            return slot;
+        }
+    }
+    uint64_t slot = capacity();
+    freeSlots.resize(words + SWAP_SLAB_SLOTS / BITMAP_WORD_BITS, ~0ULL);
+    freeSlots[words] &= ~1ULL;
+    nextSlot = slot + 1;
+    return slot;
+}
+
+uint64_t SwapSlotTable::homePosition(uint64_t pageIndex) const {
+    // fibonacci hashing spreads consecutive pages over the index
+    return (pageIndex * 0x9E3779B97F4A7C15ULL) & (indexKeys.size() - 1);
+}
+
+/*
+ * Returns the index position holding the page, or the empty position where
+ * it would be inserted.
+ */
+uint64_t SwapSlotTable::findPosition(uint64_t pageIndex) const {
+    uint64_t mask = indexKeys.size() - 1;
+    uint64_t position = homePosition(pageIndex);
+    while (indexKeys[position] != EMPTY_KEY && indexKeys[position] != pageIndex)
+        position = (position + 1) & mask;
+    return position;
+}
+
+void SwapSlotTable::insert(uint64_t pageIndex, uint64_t slot) {
+    // keep the load factor under one half so probe sequences stay short
+    if ((indexSize + 1) * 2 > indexKeys.size())
+        growIndex();
+    uint64_t position = findPosition(pageIndex);
+    indexKeys[position] = pageIndex;
+    indexSlots[position] = slot;
+    indexSize++;
+}
+
+void SwapSlotTable::growIndex() {
+    std::vector<uint64_t> oldKeys;
+    std::vector<uint64_t> oldSlots;
+    oldKeys.swap(indexKeys);
+    oldSlots.swap(indexSlots);
+
+    uint64_t capacity = oldKeys.empty() ? INITIAL_INDEX_CAPACITY
+                                        : oldKeys.size() * 2;
+    indexKeys.assign(capacity, EMPTY_KEY);
+    indexSlots.assign(capacity, 0);
+    for (uint64_t position = 0; position < oldKeys.size(); position++) {
+        if (oldKeys[position] == EMPTY_KEY)
+            continue;
+        uint64_t newPosition = findPosition(oldKeys[position]);
+        indexKeys[newPosition] = oldKeys[position];
+        indexSlots[newPosition] = oldSlots[position];
+    }
+}
+
+bool SwapSlotTable::find(uint64_t pageIndex, uint64_t& slot) const {
+    uint64_t position = findPosition(pageIndex);
+    if (indexKeys[position] != pageIndex)
+        return false;
+    slot = indexSlots[position];
+    return true;
+}
+
+uint64_t SwapSlotTable::assign(uint64_t pageIndex) {
+    assert(pageIndex != EMPTY_KEY);
+    uint64_t position = findPosition(pageIndex);
+    if (indexKeys[position] == pageIndex)
+        return indexSlots[position];
+    uint64_t slot = allocateSlot();
+    insert(pageIndex, slot);
+    return slot;
+}
+
+void SwapSlotTable::release(uint64_t pageIndex) {
+    uint64_t mask = indexKeys.size() - 1;
+    uint64_t position = findPosition(pageIndex);
+    if (indexKeys[position] != pageIndex)
+        return;
+    uint64_t slot = indexSlots[position];
+    freeSlots[slot / BITMAP_WORD_BITS] |= 1ULL << (slot % BITMAP_WORD_BITS);
+    indexKeys[position] = EMPTY_KEY;
+    indexSize--;
+
+    // shift back the following entries of the probe run so lookups that
+    // passed through the removed position still find them
+    uint64_t hole = position;
+    for (uint64_t next = (hole + 1) & mask; indexKeys[next] != EMPTY_KEY;
+         next = (next + 1) & mask) {
+        uint64_t home = homePosition(indexKeys[next]);
+        bool movable = (next > hole) ? (home <= hole || home > next)
+                                     : (home <= hole && home > next);
+        if (movable) {
+            indexKeys[hole] = indexKeys[next];
+            indexSlots[hole] = indexSlots[next];
+            indexKeys[next] = EMPTY_KEY;
+            hole = next;
+        }
+    }
+}
+
+/*****************************************************************************
+*                               Swap Devices                                 *
+*****************************************************************************/
+
+MemorySwapDevice::~MemorySwapDevice() {
+    for (word_t* slab : slabs)
+        delete[] slab;
+}
+
+word_t* MemorySwapDevice::slotAddress(uint64_t slot) const {
+    return slabs[slot / SWAP_SLAB_SLOTS] + (slot % SWAP_SLAB_SLOTS) * PAGE_SIZE;
+}
+
+void MemorySwapDevice::reserve(uint64_t slots) {
+    while (slabs.size() * SWAP_SLAB_SLOTS < slots)
+        slabs.push_back(new word_t[SWAP_SLAB_SLOTS * PAGE_SIZE]);
+}
+
+void MemorySwapDevice::read(uint64_t slot, word_t* frame) const {
+    memcpy(frame, slotAddress(slot), FRAME_BYTES);
+}
+
+void MemorySwapDevice::write(uint64_t slot, const word_t* frame) {
+    memcpy(slotAddress(slot), frame, FRAME_BYTES);
+}
+
+static int openSwapFile() {
+#ifdef SWAP_FILE_PATH
+    int fd = open(SWAP_FILE_PATH, O_RDWR | O_CREAT | O_TRUNC, 0600);
+#else
+    // unlinked right away, so processes never share or leave behind a file
+    char path[] = SWAP_FILE_DIR "/swap-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0)
+        unlink(path);
+#endif
+    if (fd < 0)
+        swapFailure("open swap file");
+    return fd;
+}
+
+static void resizeSwapFile(int fd, uint64_t slots) {
+    if (ftruncate(fd, (off_t) (slots * FRAME_BYTES)) != 0)
+        swapFailure("ftruncate swap file");
+}
+
+PreadSwapDevice::PreadSwapDevice() : fd(openSwapFile()) {}
+
+PreadSwapDevice::~PreadSwapDevice() {
+    close(fd);
+}
+
+void PreadSwapDevice::reserve(uint64_t slots) {
+    if (slots <= fileSlots)
+        return;
+    resizeSwapFile(fd, slots);
+    fileSlots = slots;
+}
+
+void PreadSwapDevice::read(uint64_t slot, word_t* frame) const {
+    char* buffer = reinterpret_cast<char*>(frame);
+    off_t offset = (off_t) (slot * FRAME_BYTES);
+    size_t done = 0;
+    while (done < FRAME_BYTES) {
+        ssize_t count = pread(fd, buffer + done, FRAME_BYTES - done, offset + done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            swapFailure("pread swap file");
+        done += count;
+    }
+}
+
+void PreadSwapDevice::write(uint64_t slot, const word_t* frame) {
+    const char* buffer = reinterpret_cast<const char*>(frame);
+    off_t offset = (off_t) (slot * FRAME_BYTES);
+    size_t done = 0;
+    while (done < FRAME_BYTES) {
+        ssize_t count = pwrite(fd, buffer + done, FRAME_BYTES - done, offset + done);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            swapFailure("pwrite swap file");
+        done += count;
+    }
+}
+
+MmapSwapDevice::MmapSwapDevice() : fd(openSwapFile()) {}
+
+MmapSwapDevice::~MmapSwapDevice() {
+    if (mapping != nullptr)
+        munmap(mapping, mappedSlots * FRAME_BYTES);
+    close(fd);
+}
+
+void MmapSwapDevice::reserve(uint64_t slots) {
+    if (slots <= mappedSlots)
+        return;
+    uint64_t newSlots = (slots > mappedSlots * 2) ? slots : mappedSlots * 2;
+    resizeSwapFile(fd, newSlots);
+    if (mapping != nullptr)
+        munmap(mapping, mappedSlots * FRAME_BYTES);
+    void* address = mmap(nullptr, newSlots * FRAME_BYTES, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+    if (address == MAP_FAILED)
+        swapFailure("mmap swap file");
+    mapping = static_cast<word_t*>(address);
+    mappedSlots = newSlots;
+}
+
+void MmapSwapDevice::read(uint64_t slot, word_t* frame) const {
+    memcpy(frame, mapping + slot * PAGE_SIZE, FRAME_BYTES);
+}
+
+void MmapSwapDevice::write(uint64_t slot, const word_t* frame) {
+    memcpy(mapping + slot * PAGE_SIZE, frame, FRAME_BYTES);
+}
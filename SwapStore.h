@@ -0,0 +1,356 @@
+#pragma once
+
+#include "MemoryConstants.h"
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define SWAP_MEMORY 0
+#define SWAP_FILE_PREAD 1
+#define SWAP_FILE_MMAP 2
+
+// where evicted pages are kept, chosen at compile time
+#ifndef SWAP_BACKEND
+#define SWAP_BACKEND SWAP_MEMORY
+#endif
+
+// the file backed swap devices create an unnamed file in SWAP_FILE_DIR,
+// removed with the process, unless SWAP_FILE_PATH names a file to use
+#ifndef SWAP_FILE_DIR
+#define SWAP_FILE_DIR "/tmp"
+#endif
+
+// number of page slots added at once when the swap store grows
+#define SWAP_SLAB_SLOTS 256
+
+// evicted pages are written to the device by a background thread
+#ifndef SWAP_WRITE_BEHIND
+#define SWAP_WRITE_BEHIND 0
+#endif
+
+// number of evicted pages that may wait for the background writer
+#ifndef SWAP_STAGING_PAGES
+#define SWAP_STAGING_PAGES 64
+#endif
+
+/*
+ * Maps pages to page sized swap slots and hands out free slots.
+ * Slots are allocated next-fit from the slot after the last allocation,
+ * so pages evicted one after the other land in consecutive slots.
+ * Pages are found through an open addressing index, so once the table has
+ * grown to its working size assigning and releasing slots does not allocate.
+ */
+class SwapSlotTable {
+public:
+    SwapSlotTable();
+
+    /*
+     * Puts the slot holding the page in 'slot'.
+     * Returns false if the page has no slot.
+     */
+    bool find(uint64_t pageIndex, uint64_t& slot) const;
+
+    /*
+     * Returns the slot holding the page, allocating one if it has none.
+     */
+    uint64_t assign(uint64_t pageIndex);
+
+    /*
+     * Frees the slot of the page, if it has one.
+     */
+    void release(uint64_t pageIndex);
+
+    // number of slots the table may hand out without growing
+    uint64_t capacity() const;
+
+private:
+    uint64_t allocateSlot();
+    uint64_t homePosition(uint64_t pageIndex) const;
+    uint64_t findPosition(uint64_t pageIndex) const;
+    void insert(uint64_t pageIndex, uint64_t slot);
+    void growIndex();
+
+    // bit per slot, set while the slot is free
+    std::vector<uint64_t> freeSlots;
+    uint64_t nextSlot = 0;
+
+    // linear probing index from page to slot, EMPTY_KEY marks free positions
+    std::vector<uint64_t> indexKeys;
+    std::vector<uint64_t> indexSlots;
+    uint64_t indexSize = 0;
+};
+
+/*
+ * Slots kept in process memory, in slabs of SWAP_SLAB_SLOTS pages.
+ */
+class MemorySwapDevice {
+public:
+    ~MemorySwapDevice();
+    void reserve(uint64_t slots);
+    void read(uint64_t slot, word_t* frame) const;
+    void write(uint64_t slot, const word_t* frame);
+
+private:
+    word_t* slotAddress(uint64_t slot) const;
+
+    std::vector<word_t*> slabs;
+};
+
+/*
+ * Slots kept in the swap file and accessed with pread and pwrite.
+ */
+class PreadSwapDevice {
+public:
+    PreadSwapDevice();
+    ~PreadSwapDevice();
+    void reserve(uint64_t slots);
+    void read(uint64_t slot, word_t* frame) const;
+    void write(uint64_t slot, const word_t* frame);
+
+private:
+    int fd;
+    uint64_t fileSlots = 0;
+};
+
+/*
+ * Slots kept in the swap file, mapped into memory as a whole.
+ * The mapping grows geometrically to keep remapping rare.
+ */
+class MmapSwapDevice {
+public:
+    MmapSwapDevice();
+    ~MmapSwapDevice();
+    void reserve(uint64_t slots);
+    void read(uint64_t slot, word_t* frame) const;
+    void write(uint64_t slot, const word_t* frame);
+
+private:
+    int fd;
+    word_t* mapping = nullptr;
+    uint64_t mappedSlots = 0;
+};
+
+/*
+ * Swap storage for evicted pages on top of one of the devices above.
+ */
+template <typename Device>
+class SlotSwapStore {
+public:
+    /*
+     * Copies the stored page into 'frame'.
+     * Returns false if the page is not in the store.
+     */
+    bool read(uint64_t pageIndex, word_t* frame) const {
+        uint64_t slot;
+        if (!slots.find(pageIndex, slot))
+            return false;
+        device.read(slot, frame);
+        return true;
+    }
+
+    /*
+     * Stores a copy of 'frame' as the content of the page.
+     */
+    void write(uint64_t pageIndex, const word_t* frame) {
+        uint64_t slot = slots.assign(pageIndex);
+        device.reserve(slots.capacity());
+        device.write(slot, frame);
+    }
+
+    bool contains(uint64_t pageIndex) const {
+        uint64_t slot;
+        return slots.find(pageIndex, slot);
+    }
+
+    /*
+     * Drops the page from the store and frees its slot.
+     */
+    void discard(uint64_t pageIndex) {
+        slots.release(pageIndex);
+    }
+
+private:
+    SwapSlotTable slots;
+    Device device;
+};
+
+/*
+ * Puts a bounded staging area in front of another store. Writes copy the
+ * page into a staging buffer and return, a background thread flushes the
+ * buffers to the store in eviction order, and reads look at the staging
+ * area before the store. Writers wait when every buffer is in use.
+ */
+template <typename Store>
+class WriteBehindSwapStore {
+public:
+    WriteBehindSwapStore()
+            : buffers(SWAP_STAGING_PAGES * PAGE_SIZE),
+              slots(SWAP_STAGING_PAGES),
+              flusher(&WriteBehindSwapStore::flushLoop, this) {}
+
+    ~WriteBehindSwapStore() {
+        {
+            std::lock_guard<std::mutex> lock(stagingMutex);
+            stopping = true;
+        }
+        queueChanged.notify_all();
+        flusher.join();
+    }
+
+    bool read(uint64_t pageIndex, word_t* frame) {
+        {
+            std::lock_guard<std::mutex> lock(stagingMutex);
+            int slot = findStaged(pageIndex);
+            if (slot != NO_SLOT) {
+                memcpy(frame, buffer(slot), PAGE_SIZE * sizeof(word_t));
+                return true;
+            }
+        }
+        std::lock_guard<std::mutex> lock(storeMutex);
+        return store.read(pageIndex, frame);
+    }
+
+    void write(uint64_t pageIndex, const word_t* frame) {
+        std::unique_lock<std::mutex> lock(stagingMutex);
+        // a queued copy of the page is simply replaced
+        int slot = findQueued(pageIndex);
+        if (slot == NO_SLOT) {
+            slotFreed.wait(lock, [this] { return freeSlots > 0; });
+            slot = takeFreeSlot();
+            slots[slot] = {pageIndex, QUEUED};
+            queue[(queueHead + queueLength) % SWAP_STAGING_PAGES] = slot;
+            queueLength++;
+            queueChanged.notify_one();
+        }
+        memcpy(buffer(slot), frame, PAGE_SIZE * sizeof(word_t));
+    }
+
+    bool contains(uint64_t pageIndex) {
+        {
+            std::lock_guard<std::mutex> lock(stagingMutex);
+            if (findStaged(pageIndex) != NO_SLOT)
+                return true;
+        }
+        std::lock_guard<std::mutex> lock(storeMutex);
+        return store.contains(pageIndex);
+    }
+
+    void discard(uint64_t pageIndex) {
+        {
+            std::unique_lock<std::mutex> lock(stagingMutex);
+            int slot = findQueued(pageIndex);
+            if (slot != NO_SLOT)
+                slots[slot].state = CANCELLED;
+            // a copy already being written must land before it is dropped
+            slotFreed.wait(lock, [this, pageIndex] {
+                return findStaged(pageIndex) == NO_SLOT;
+            });
+        }
+        std::lock_guard<std::mutex> lock(storeMutex);
+        store.discard(pageIndex);
+    }
+
+private:
+    enum SlotState {
+        FREE,
+        QUEUED,
+        FLUSHING,
+        CANCELLED
+    };
+
+    typedef struct {
+        uint64_t page;
+        SlotState state;
+    } StagingSlot;
+
+    static const int NO_SLOT = -1;
+
+    word_t* buffer(int slot) {
+        return buffers.data() + slot * PAGE_SIZE;
+    }
+
+    int findSlot(uint64_t pageIndex, SlotState state) const {
+        for (int slot = 0; slot < SWAP_STAGING_PAGES; slot++) {
+            if (slots[slot].state == state && slots[slot].page == pageIndex)
+                return slot;
+        }
+        return NO_SLOT;
+    }
+
+    int findQueued(uint64_t pageIndex) const {
+        return findSlot(pageIndex, QUEUED);
+    }
+
+    // a queued copy is newer than one being flushed
+    int findStaged(uint64_t pageIndex) const {
+        int slot = findSlot(pageIndex, QUEUED);
+        return slot != NO_SLOT ? slot : findSlot(pageIndex, FLUSHING);
+    }
+
+    int takeFreeSlot() {
+        freeSlots--;
+        for (int slot = 0; slot < SWAP_STAGING_PAGES; slot++) {
+            if (slots[slot].state == FREE)
+                return slot;
+        }
+        return NO_SLOT;
+    }
+
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(stagingMutex);
+        while (true) {
+            queueChanged.wait(lock, [this] { return queueLength > 0 || stopping; });
+            // pending pages are still flushed on shutdown
+            if (queueLength == 0)
+                return;
+            int slot = queue[queueHead];
+            queueHead = (queueHead + 1) % SWAP_STAGING_PAGES;
+            queueLength--;
+            if (slots[slot].state == QUEUED) {
+                slots[slot].state = FLUSHING;
+                lock.unlock();
+                {
+                    std::lock_guard<std::mutex> storeLock(storeMutex);
+                    store.write(slots[slot].page, buffer(slot));
+                }
+                lock.lock();
+            }
+            slots[slot].state = FREE;
+            freeSlots++;
+            slotFreed.notify_all();
+        }
+    }
+
+    Store store;
+    std::mutex storeMutex;
+
+    std::vector<word_t> buffers;
+    std::vector<StagingSlot> slots;
+    int freeSlots = SWAP_STAGING_PAGES;
+    // staging slots in eviction order
+    int queue[SWAP_STAGING_PAGES];
+    int queueHead = 0;
+    int queueLength = 0;
+    bool stopping = false;
+    std::mutex stagingMutex;
+    std::condition_variable queueChanged;
+    std::condition_variable slotFreed;
+
+    std::thread flusher;
+};
+
+#if SWAP_BACKEND == SWAP_FILE_PREAD
+typedef SlotSwapStore<PreadSwapDevice> SwapDeviceStore;
+#elif SWAP_BACKEND == SWAP_FILE_MMAP
+typedef SlotSwapStore<MmapSwapDevice> SwapDeviceStore;
+#else
+typedef SlotSwapStore<MemorySwapDevice> SwapDeviceStore;
+#endif
+
+#if SWAP_WRITE_BEHIND
+typedef WriteBehindSwapStore<SwapDeviceStore> SwapStore;
+#else
+typedef SwapDeviceStore SwapStore;
+#endif
@@ -0,0 +1,97 @@
+#include "TestSupport.h"
+#include "VirtualMemory.h"
+
+#include <random>
+#include <vector>
+
+// pages written, more than the RAM and more than a slab of swap slots hold
+#define PAGES (8 * NUM_FRAMES)
+#define ROUNDS 3
+#define ACCESSES 20000
+
+static word_t valueOf(uint64_t address, int round) {
+    return (word_t) (address * 13 + round);
+}
+
+/*
+ * Rewrites every page in every round, so pages are evicted dirty one after
+ * the other, then reads them all back, restoring each of them from the swap
+ * store or from what is still waiting to be written to it.
+ */
+static void testRoundsReadBack() {
+    VMinitialize();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (uint64_t address = 0; address < PAGES * PAGE_SIZE; address++)
+            check(VMwrite(address, valueOf(address, round)) == 1, "write");
+        for (uint64_t address = 0; address < PAGES * PAGE_SIZE; address++) {
+            word_t value = 0;
+            check(VMread(address, &value) == 1, "read");
+            check(value == valueOf(address, round), "a read returns the value of the round");
+        }
+    }
+}
+
+/*
+ * Reads pages back soon after they were evicted and writes some of them
+ * again, so copies still waiting to be written are read, replaced and
+ * dropped.
+ */
+static void testRecentlyEvictedPages() {
+    VMinitialize();
+    std::vector<word_t> written(PAGES * PAGE_SIZE);
+    for (uint64_t address = 0; address < PAGES * PAGE_SIZE; address++) {
+        written[address] = valueOf(address, 0);
+        check(VMwrite(address, written[address]) == 1, "write");
+    }
+    std::mt19937_64 random(3);
+    uint64_t page = 0;
+    for (int access = 0; access < ACCESSES; access++) {
+        // mostly the pages evicted last, now and then any page
+        if (random() % 4 == 0)
+            page = random() % PAGES;
+        else
+            page = (page + NUM_FRAMES - random() % 4) % PAGES;
+        uint64_t address = page * PAGE_SIZE + random() % PAGE_SIZE;
+        if (random() % 2) {
+            written[address] = (word_t) (random() % 1000000);
+            check(VMwrite(address, written[address]) == 1, "write");
+        } else {
+            word_t value = 0;
+            check(VMread(address, &value) == 1, "read");
+            check(value == written[address], "a read returns the last value written");
+        }
+    }
+    for (uint64_t address = 0; address < PAGES * PAGE_SIZE; address++) {
+        word_t value = 0;
+        check(VMread(address, &value) == 1, "read");
+        check(value == written[address], "every page holds its last values");
+    }
+}
+
+/*
+ * Two pages at the greatest cyclic distance from each other evict each
+ * other on every fault once the RAM is full, so each is restored right
+ * after it was evicted, while its copy may still be waiting to be written.
+ */
+static void testPagesEvictingEachOther() {
+    VMinitialize();
+    for (uint64_t address = 0; address < PAGES * PAGE_SIZE; address++)
+        check(VMwrite(address, 0) == 1, "write");
+    const uint64_t first = 0;
+    const uint64_t second = VIRTUAL_MEMORY_SIZE / 2;
+    check(VMwrite(second, 0) == 1, "write");
+    for (int round = 1; round <= ACCESSES / 4; round++) {
+        word_t value = -1;
+        check(VMwrite(first, round) == 1, "write");
+        check(VMread(second, &value) == 1 && value == round - 1, "a read returns the last value written");
+        check(VMwrite(second, round) == 1, "write");
+        check(VMread(first, &value) == 1 && value == round, "a read returns the last value written");
+    }
+}
+
+int main() {
+    testRoundsReadBack();
+    testRecentlyEvictedPages();
+    testPagesEvictingEachOther();
+    return testResult();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+
+// checks that failed so far, from any thread
+static std::atomic<int> failures{0};
+
+static void check(bool condition, const char* what) {
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// reports the checks and returns the exit status of the test
+static int testResult() {
+    if (failures > 0) {
+        printf("%d checks failed\n", failures.load());
+        return 1;
+    }
+    printf("success\n");
+    return 0;
+}
@@ -1,6 +1,15 @@
 
 #include "VirtualMemory.h"
 #include "PhysicalMemory.h"
+#include "ReplacementPolicy.h"
+#include "ReaderEpochs.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #define ROOT_FRAME 0
 #define PAGE_FAULT 0
@@ -9,6 +18,70 @@
 #define FAILURE_RET_VAL 0
 #define NO_FRAME_FOUND (-1)
 
+//Readahead of sequential and strided faults, 0 disables it
+#ifndef READAHEAD_MAX_WINDOW
+#define READAHEAD_MAX_WINDOW 0
+#endif
+#define READAHEAD_MIN_WINDOW 1
+
+//Flags kept in the spare high bits of a page table entry
+#define PTE_ACCESSED ((word_t) 1 << (WORD_WIDTH - 2))
+#define PTE_DIRTY ((word_t) 1 << (WORD_WIDTH - 3))
+//Set on pages mapped by readahead until their first access
+#define PTE_PREFETCHED ((word_t) 1 << (WORD_WIDTH - 4))
+#define PTE_FLAGS (PTE_ACCESSED | PTE_DIRTY | PTE_PREFETCHED)
+#define PTE_FRAME(entry) ((entry) & ~PTE_FLAGS)
+//A leaf entry after an access with access_flags, which always include
+//PTE_ACCESSED
+#define PTE_AFTER_ACCESS(entry, access_flags) \
+    (((entry) | (access_flags)) & ~PTE_PREFETCHED)
+
+static_assert (NUM_FRAMES <= PTE_PREFETCHED,
+               "frame indices must not overlap the page table entry flags");
+
+//TLB geometry, may be overridden at compile time
+#ifndef TLB_SETS
+#define TLB_SETS 16
+#endif
+#ifndef TLB_WAYS
+#define TLB_WAYS 4
+#endif
+
+//Find empty tables through the frame bitmap instead of a DFS over the tree
+#ifndef INDEXED_FRAME_SEARCH
+#define INDEXED_FRAME_SEARCH 1
+#endif
+//Without the bitmap, collect all three priorities in one walk of the tree
+#ifndef FUSED_FAULT_HANDLER
+#define FUSED_FAULT_HANDLER 1
+#endif
+//The cyclic distance victim is found by walking the tree unless indexed
+#if REPLACEMENT_POLICY == POLICY_CYCLIC_DISTANCE && !INDEXED_FRAME_SEARCH
+#define TREE_WALK_EVICTION 1
+#else
+#define TREE_WALK_EVICTION 0
+#endif
+//Number of address spaces that may exist at once
+#ifndef MAX_SPACES
+#define MAX_SPACES 16
+#endif
+static_assert (SPACE_KEY_SHIFT < 63
+               && ((uint64_t) (MAX_SPACES - 1) >> (63 - SPACE_KEY_SHIFT)) == 0,
+               "page keys of every space must fit in 63 bits");
+#if BACKGROUND_RECLAIM && !CONCURRENT_VM
+#error "BACKGROUND_RECLAIM needs CONCURRENT_VM"
+#endif
+//Frames freed per hold of the fault lock
+#define RECLAIM_BATCH 8
+static_assert (RECLAIM_LOW_WATERMARK > 0
+               && RECLAIM_LOW_WATERMARK <= RECLAIM_HIGH_WATERMARK
+               && RECLAIM_HIGH_WATERMARK <= NUM_FRAMES / 2,
+               "the free frame watermarks must leave frames for the tables");
+#define BITMAP_WORD_BITS 64
+#define BITMAP_WORDS ((NUM_FRAMES + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+#define BITMAP_SUMMARY_WORDS \
+    ((BITMAP_WORDS + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS)
+
 /*****************************************************************************
 *                          Binary Calculations                               *
 *****************************************************************************/
@@ -47,28 +120,670 @@ uint64_t getNextPage (uint64_t current_page, uint64_t current_row)
 }
 
 /*****************************************************************************
-*                            DFS Implementation                              *
+*                      Translation Lookaside Buffer                          *
 *****************************************************************************/
 
+/*
+ * Entries map resident pages only and are dropped when their page is
+ * evicted. An entry points into the leaf table holding its page, so a table
+ * is empty, and may be reclaimed, only once no entry points into it.
+ */
+typedef struct
+{
+    bool valid;
+    //Key of the page, so spaces share the TLB without flushing on a switch
+    uint64_t page;
+    word_t frame;
+    //Physical address of the leaf entry and the flags already set in it
+    uint64_t pte_address;
+    word_t pte_flags;
+} TlbEntry;
+
+#if CONCURRENT_VM
+//Every thread translates from its own TLB, so hits touch no shared state
+thread_local TlbEntry tlb[TLB_SETS][TLB_WAYS];
+thread_local uint64_t tlb_next_way[TLB_SETS];
+thread_local uint64_t tlb_hits = 0;
+thread_local uint64_t tlb_misses = 0;
+/*
+ * Bumped whenever a frame leaves the tables. A thread flushes its TLB the
+ * next time it translates, so any number of evictions since then cost it
+ * a single flush.
+ */
+std::atomic<uint64_t> tlb_generation{0};
+//Generation of the last VMinitialize, which also clears the counters
+std::atomic<uint64_t> tlb_reset_generation{0};
+thread_local uint64_t tlb_seen_generation = 0;
+#else
+TlbEntry tlb[TLB_SETS][TLB_WAYS];
+uint64_t tlb_next_way[TLB_SETS];
+uint64_t tlb_hits = 0;
+uint64_t tlb_misses = 0;
+#endif
+
+void tlbClear ()
+{
+  for (uint64_t set = 0; set < TLB_SETS; set++)
+  {
+    for (uint64_t way = 0; way < TLB_WAYS; way++)
+    {
+      tlb[set][way].valid = false;
+    }
+    tlb_next_way[set] = 0;
+  }
+}
+
+#if CONCURRENT_VM
+/*
+ * Makes every thread drop its translations before its next one. Called
+ * before the grace period of an unlinked frame, so a thread that still
+ * uses a stale entry is one the unlinking thread waits for.
+ */
+void tlbShootdown ()
+{
+  tlb_generation.fetch_add (1, std::memory_order_seq_cst);
+}
+
+void tlbSynchronize ()
+{
+  uint64_t generation = tlb_generation.load (std::memory_order_seq_cst);
+  if (generation == tlb_seen_generation)
+  {
+    return;
+  }
+  tlbClear ();
+  if (tlb_reset_generation.load (std::memory_order_relaxed)
+      > tlb_seen_generation)
+  {
+    tlb_hits = 0;
+    tlb_misses = 0;
+  }
+  tlb_seen_generation = generation;
+}
+#endif
+
+void tlbFlush ()
+{
+  tlbClear ();
+  tlb_hits = 0;
+  tlb_misses = 0;
+#if CONCURRENT_VM
+  tlbShootdown ();
+  tlb_reset_generation.store (tlb_generation.load ());
+  tlb_seen_generation = tlb_generation.load ();
+#endif
+}
+
+TlbEntry *tlbLookup (uint64_t page_number)
+{
+#if CONCURRENT_VM
+  tlbSynchronize ();
+#endif
+  TlbEntry *set = tlb[page_number % TLB_SETS];
+  for (uint64_t way = 0; way < TLB_WAYS; way++)
+  {
+    if (set[way].valid && set[way].page == page_number)
+    {
+      tlb_hits++;
+      return &set[way];
+    }
+  }
+  tlb_misses++;
+  return nullptr;
+}
 
+TlbEntry *tlbInsert (uint64_t page_number, word_t frame,
+                     uint64_t pte_address, word_t pte_flags)
+{
+  uint64_t set_index = page_number % TLB_SETS;
+  //Round robin replacement inside the set
+  uint64_t way = tlb_next_way[set_index];
+  tlb_next_way[set_index] = (way + 1) % TLB_WAYS;
+  tlb[set_index][way] = {true, page_number, frame, pte_address, pte_flags};
+  return &tlb[set_index][way];
+}
 
+void tlbInvalidatePage (uint64_t page_number)
+{
+  TlbEntry *set = tlb[page_number % TLB_SETS];
+  for (uint64_t way = 0; way < TLB_WAYS; way++)
+  {
+    if (set[way].valid && set[way].page == page_number)
+    {
+      set[way].valid = false;
+    }
+  }
+}
 
 /*****************************************************************************
-*                               Priority 1                                  *
+*                               Concurrency                                  *
 *****************************************************************************/
 
-bool isFrameEmpty (word_t frame_index)
+#if CONCURRENT_VM
+ReaderEpochs reader_epochs;
+//Serializes faults and every change to the spaces
+std::mutex fault_mutex;
+//Serializes the policies that track accesses between faults and the
+//batches of accesses the threads pass to them
+std::mutex policy_mutex;
+
+/*
+ * Keeps the frames translated by one API call from being reused until the
+ * call returns. Translations of resident pages take no lock, and a fault
+ * leaves the epoch while it waits for the writer lock, as the writer
+ * holding it may be waiting for this thread.
+ */
+class AccessGuard
 {
-  for (uint64_t row = 0; row < PAGE_SIZE; row++)
+ public:
+  AccessGuard ()
+  {
+    reader_epochs.enter ();
+  }
+
+  ~AccessGuard ()
+  {
+    reader_epochs.leave ();
+  }
+
+  void enter ()
+  {
+    reader_epochs.enter ();
+  }
+
+  void leave ()
+  {
+    reader_epochs.leave ();
+  }
+};
+
+//Held while the tables or the spaces are changed
+class WriterGuard
+{
+ public:
+  WriterGuard () : lock (fault_mutex)
+  {}
+
+ private:
+  std::lock_guard<std::mutex> lock;
+};
+#else
+//Without concurrent mode every call owns the tables
+class AccessGuard
+{
+ public:
+  AccessGuard ()
+  {}
+
+  void enter ()
+  {}
+
+  void leave ()
+  {}
+};
+
+class WriterGuard
+{
+ public:
+  WriterGuard ()
+  {}
+};
+#endif
+
+/*****************************************************************************
+*                             Address Spaces                                 *
+*****************************************************************************/
+
+#if READAHEAD_MAX_WINDOW > 0
+//Faults of one space, so spaces that fault in turn keep their own streams
+typedef struct
+{
+    //Last page of the stream, either faulted or read ahead
+    uint64_t last_page;
+    int64_t stride;
+    uint64_t window;
+    //Read ahead pages that were used or evicted unused since the last burst
+    uint64_t recent_useful;
+    uint64_t recent_wasted;
+} StreamDetector;
+#endif
+
+typedef struct
+{
+    //Root table of the space, kept in memory as long as the space exists
+    word_t root;
+    uint64_t page_faults;
+    uint64_t evictions;
+    uint64_t resident_pages;
+    //Pages other spaces may not evict, and pages the space may hold
+    uint64_t min_pages;
+    uint64_t max_pages;
+    //Share of the memory under fair replacement
+    uint64_t weight;
+#if READAHEAD_MAX_WINDOW > 0
+    StreamDetector stream;
+#endif
+} AddressSpace;
+
+//Spaces are never destroyed, so the existing spaces are 0..space_count-1.
+//The count is raised only once the new space is filled in, so a space
+//below a count read with acquire may be used without the writer lock.
+AddressSpace spaces[MAX_SPACES];
+uint64_t space_count = 0;
+#if CONCURRENT_VM
+//Every thread has its own current space. VMinitialize cannot reset those
+//of the other threads, so it bumps the generation instead, and a thread
+//that sees a newer one goes back to the default space.
+thread_local space_t current_space = DEFAULT_SPACE;
+thread_local uint64_t space_seen_generation = 0;
+std::atomic<uint64_t> space_reset_generation{0};
+#else
+space_t current_space = DEFAULT_SPACE;
+#endif
+int replacement_scope = GLOBAL_REPLACEMENT;
+
+AddressSpace emptySpace (word_t root)
+{
+  AddressSpace space = {root, 0, 0, 0, 0, UNLIMITED_PAGES, 1};
+#if READAHEAD_MAX_WINDOW > 0
+  space.stream = {0, 0, READAHEAD_MIN_WINDOW, 0, 0};
+#endif
+  return space;
+}
+
+void resetSpaces ()
+{
+  spaces[DEFAULT_SPACE] = emptySpace (ROOT_FRAME);
+  space_count = 1;
+#if CONCURRENT_VM
+  space_reset_generation.fetch_add (1, std::memory_order_release);
+#else
+  current_space = DEFAULT_SPACE;
+#endif
+  replacement_scope = GLOBAL_REPLACEMENT;
+}
+
+//The current space of the calling thread
+space_t currentSpace ()
+{
+#if CONCURRENT_VM
+  uint64_t generation = space_reset_generation.load (
+      std::memory_order_acquire);
+  if (generation != space_seen_generation)
+  {
+    current_space = DEFAULT_SPACE;
+    space_seen_generation = generation;
+  }
+#endif
+  return current_space;
+}
+
+AddressSpace &spaceOf (uint64_t page_key)
+{
+  return spaces[keySpace (page_key)];
+}
+
+/*****************************************************************************
+*                             Frame Scheduler                                *
+*****************************************************************************/
+
+//Spaces the fault being handled may evict pages from
+bool evictable_spaces[MAX_SPACES];
+
+bool isSpaceEvictable (uint64_t space)
+{
+  return evictable_spaces[space];
+}
+
+/*
+ * Decides which spaces a fault in faulting_space may evict from:
+ * - a space at its maximum replaces its own pages;
+ * - otherwise only spaces above their minimum are evicted from, all of them
+ *   under global replacement, or the one furthest above its weighted share
+ *   under fair replacement;
+ * - if every space is at its minimum, the faulting space gives up a page,
+ *   and failing that any space does.
+ */
+void selectVictimSpaces (uint64_t faulting_space)
+{
+  AddressSpace &faulting = spaces[faulting_space];
+  bool local = faulting.resident_pages >= faulting.max_pages;
+  bool any_above_minimum = false;
+  uint64_t heaviest = faulting_space;
+  for (uint64_t space = 0; space < space_count; space++)
   {
-    word_t value;
-    PMread ((uint64_t) (frame_index) * PAGE_SIZE + row, &value);
-    if (value != PAGE_FAULT)
+    AddressSpace &candidate = spaces[space];
+    bool above_minimum = candidate.resident_pages > candidate.min_pages;
+    //Compares resident_pages / weight without dividing
+    if (above_minimum
+        && (!any_above_minimum
+            || candidate.resident_pages * spaces[heaviest].weight
+               > spaces[heaviest].resident_pages * candidate.weight))
     {
-      return false;
+      heaviest = space;
     }
+    any_above_minimum = any_above_minimum || above_minimum;
+    evictable_spaces[space] = (local) ? space == faulting_space
+                                      : above_minimum;
   }
-  return true;
+  if (local)
+  {
+    return;
+  }
+  bool has_pages = faulting.resident_pages > 0;
+  for (uint64_t space = 0; space < space_count; space++)
+  {
+    if (!any_above_minimum)
+    {
+      evictable_spaces[space] = (has_pages) ? space == faulting_space
+                                            : spaces[space].resident_pages > 0;
+    }
+    else if (replacement_scope == FAIR_REPLACEMENT)
+    {
+      evictable_spaces[space] = space == heaviest;
+    }
+  }
+}
+
+/*****************************************************************************
+*                            Frame Bookkeeping                               *
+*****************************************************************************/
+
+#if INDEXED_FRAME_SEARCH
+#define FRAME_LINKED 1
+#define FRAME_TABLE 2
+
+static_assert (OFFSET_WIDTH < 32 && TABLES_DEPTH < 256,
+               "rows and depths must fit the frame table fields");
+
+//Reverse map from frames to their place in the tree, one array per field.
+//Fields are kept narrow since the map grows with the number of frames.
+typedef struct
+{
+    //Table and row that currently reference the frame
+    word_t parent[NUM_FRAMES];
+    uint32_t row[NUM_FRAMES];
+    //Depth of the frame in the tree, the root is at depth 0
+    uint8_t level[NUM_FRAMES];
+    //Page number of a leaf, or the rows along the path of a table
+    uint64_t page[NUM_FRAMES];
+    //Number of non empty rows in a table
+    uint32_t live_entries[NUM_FRAMES];
+    uint8_t flags[NUM_FRAMES];
+} FrameTable;
+
+FrameTable frame_table;
+//Bit per frame, set when the frame is a linked non root table with no rows
+uint64_t empty_tables[BITMAP_WORDS];
+//Bit per word of empty_tables, set when the word is not 0, so finding an
+//empty table does not scan the whole bitmap of a large memory
+uint64_t empty_table_words[BITMAP_SUMMARY_WORDS];
+//Largest frame index ever handed out since the last VMinitialize
+word_t frame_high_water = ROOT_FRAME;
+
+void markTableEmpty (word_t frame, bool empty)
+{
+  uint64_t word = frame / BITMAP_WORD_BITS;
+  uint64_t bit = (uint64_t) 1 << (frame % BITMAP_WORD_BITS);
+  uint64_t word_bit = (uint64_t) 1 << (word % BITMAP_WORD_BITS);
+  if (empty)
+  {
+    empty_tables[word] |= bit;
+    empty_table_words[word / BITMAP_WORD_BITS] |= word_bit;
+  }
+  else
+  {
+    empty_tables[word] &= ~bit;
+    if (empty_tables[word] == 0)
+    {
+      empty_table_words[word / BITMAP_WORD_BITS] &= ~word_bit;
+    }
+  }
+}
+
+/*
+ * Returns true if frame is ancestor itself or lies in its subtree, which is
+ * the case when the path of ancestor is a prefix of the path of frame.
+ */
+bool isUnderFrame (word_t frame, word_t ancestor)
+{
+  uint64_t frame_level = frame_table.level[frame];
+  uint64_t ancestor_level = frame_table.level[ancestor];
+  if (frame_level < ancestor_level)
+  {
+    return false;
+  }
+  uint64_t shift = OFFSET_WIDTH * (frame_level - ancestor_level);
+  return (frame_table.page[frame] >> shift) == frame_table.page[ancestor];
+}
+#else
+//Set once the tables reach the last frame, which they never give back
+bool fresh_frames_exhausted = false;
+#endif
+
+void resetFrameBookkeeping ()
+{
+#if INDEXED_FRAME_SEARCH
+  for (uint64_t frame = 0; frame < NUM_FRAMES; frame++)
+  {
+    frame_table.flags[frame] = 0;
+  }
+  for (uint64_t word = 0; word < BITMAP_WORDS; word++)
+  {
+    empty_tables[word] = 0;
+  }
+  for (uint64_t word = 0; word < BITMAP_SUMMARY_WORDS; word++)
+  {
+    empty_table_words[word] = 0;
+  }
+  frame_table.parent[ROOT_FRAME] = ROOT_FRAME;
+  frame_table.row[ROOT_FRAME] = 0;
+  frame_table.level[ROOT_FRAME] = INITIAL_DEPTH_LEVEL;
+  frame_table.page[ROOT_FRAME] = 0;
+  frame_table.live_entries[ROOT_FRAME] = 0;
+  frame_table.flags[ROOT_FRAME] = FRAME_LINKED | FRAME_TABLE;
+  frame_high_water = ROOT_FRAME;
+#else
+  fresh_frames_exhausted = false;
+#endif
+}
+
+void linkTableEntry (word_t table, uint64_t row, word_t child, word_t flags)
+{
+  PMwrite ((uint64_t) (table) * PAGE_SIZE + row, child | flags);
+#if INDEXED_FRAME_SEARCH
+  frame_table.live_entries[table]++;
+  markTableEmpty (table, false);
+  frame_table.parent[child] = table;
+  frame_table.row[child] = row;
+  frame_table.page[child] = getNextPage (frame_table.page[table], row);
+  frame_table.flags[child] |= FRAME_LINKED;
+  //A freshly linked table was zeroed by createNewTable
+  if (frame_table.flags[child] & FRAME_TABLE)
+  {
+    markTableEmpty (child, true);
+  }
+#endif
+}
+
+void unlinkTableEntry (word_t table, uint64_t row, word_t child)
+{
+  PMwrite ((uint64_t) (table) * PAGE_SIZE + row, PAGE_FAULT);
+#if INDEXED_FRAME_SEARCH
+  frame_table.flags[child] &= ~FRAME_LINKED;
+  markTableEmpty (child, false);
+  frame_table.live_entries[table]--;
+  if (frame_table.level[table] != INITIAL_DEPTH_LEVEL
+      && frame_table.live_entries[table] == 0)
+  {
+    markTableEmpty (table, true);
+  }
+#else
+  (void) child;
+#endif
+#if CONCURRENT_VM
+  //Walks and TLB entries that reached the frame before it was unlinked
+  //must be done with it before it is reused
+  tlbShootdown ();
+  reader_epochs.waitForReaders ();
+#endif
+}
+
+/*****************************************************************************
+*                           Replacement Policy                               *
+*****************************************************************************/
+
+#if !TREE_WALK_EVICTION
+ReplacementPolicy replacement_policy;
+
+//Held around faults and evictions while accesses may update the policy
+class PolicyGuard
+{
+ public:
+  PolicyGuard ()
+  {
+#if CONCURRENT_VM
+    if (ReplacementPolicy::TRACKS_ACCESS)
+    {
+      policy_mutex.lock ();
+    }
+#endif
+  }
+
+  ~PolicyGuard ()
+  {
+#if CONCURRENT_VM
+    if (ReplacementPolicy::TRACKS_ACCESS)
+    {
+      policy_mutex.unlock ();
+    }
+#endif
+  }
+};
+#endif
+
+void policyReset ()
+{
+#if !TREE_WALK_EVICTION
+  replacement_policy.reset ();
+#endif
+}
+
+#if CONCURRENT_VM && !TREE_WALK_EVICTION
+/*
+ * Accesses of the thread that were not passed to the policy yet. They are
+ * handed over a batch at a time, so translations rarely take the policy
+ * lock, at the price of the policy seeing them late.
+ */
+#define ACCESS_BATCH_SIZE 64
+thread_local uint64_t access_batch[ACCESS_BATCH_SIZE];
+thread_local uint64_t access_batch_count = 0;
+#endif
+
+//Also called by a thread before it faults, so its own accesses count
+void policyFlushAccesses ()
+{
+#if CONCURRENT_VM && !TREE_WALK_EVICTION
+  if (!ReplacementPolicy::TRACKS_ACCESS || access_batch_count == 0)
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> guard (policy_mutex);
+  //Pages evicted since their access are no longer known to the policy
+  for (uint64_t access = 0; access < access_batch_count; access++)
+  {
+    replacement_policy.onAccess (access_batch[access]);
+  }
+  access_batch_count = 0;
+#endif
+}
+
+void policyOnAccess (uint64_t page_number)
+{
+#if !TREE_WALK_EVICTION
+#if CONCURRENT_VM
+  if (ReplacementPolicy::TRACKS_ACCESS)
+  {
+    access_batch[access_batch_count++] = page_number;
+    if (access_batch_count == ACCESS_BATCH_SIZE)
+    {
+      policyFlushAccesses ();
+    }
+    return;
+  }
+#endif
+  replacement_policy.onAccess (page_number);
+#else
+  (void) page_number;
+#endif
+}
+
+void policyOnFault (uint64_t page_number, uint64_t pte_address)
+{
+#if !TREE_WALK_EVICTION
+  PolicyGuard guard;
+  replacement_policy.onFault (page_number, pte_address);
+#else
+  (void) page_number;
+  (void) pte_address;
+#endif
+}
+
+void policyOnEvict (uint64_t page_number)
+{
+#if !TREE_WALK_EVICTION
+  PolicyGuard guard;
+  replacement_policy.onEvict (page_number);
+#else
+  (void) page_number;
+#endif
+}
+
+/*****************************************************************************
+*                           Readahead Stream                                 *
+*****************************************************************************/
+
+#if READAHEAD_MAX_WINDOW > 0
+//Totals of every space, the streams themselves are in the spaces
+uint64_t readahead_issued = 0;
+uint64_t readahead_useful = 0;
+
+void resetReadahead ()
+{
+  readahead_issued = 0;
+  readahead_useful = 0;
+}
+
+//Also called by translations running next to a fault
+void onReadaheadUsed (uint64_t page_key)
+{
+  __atomic_add_fetch (&spaceOf (page_key).stream.recent_useful, 1,
+                      __ATOMIC_RELAXED);
+  __atomic_add_fetch (&readahead_useful, 1, __ATOMIC_RELAXED);
+}
+
+void onReadaheadWasted (uint64_t page_key)
+{
+  spaceOf (page_key).stream.recent_wasted++;
+}
+#endif
+
+/*****************************************************************************
+*                            DFS Implementation                              *
+*****************************************************************************/
+
+
+
+
+/*****************************************************************************
+*                               Priority 1                                  *
+*****************************************************************************/
+
+//Flags are only ever set next to a frame, so a table is empty exactly when
+//all of its words are 0
+bool isFrameEmpty (word_t frame_index)
+{
+  return PMisFrameZero (frame_index);
 }
 
 word_t getEmptyFrame (word_t original_frame, word_t current_frame,
@@ -88,18 +803,20 @@ word_t getEmptyFrame (word_t original_frame, word_t current_frame,
 
   if (isFrameEmpty (current_frame))
   {
-    if (current_frame == ROOT_FRAME)
+    //Roots are never reclaimed
+    if (depth_level == INITIAL_DEPTH_LEVEL)
     {
       return NO_FRAME_FOUND;
     }
     //remove table reference to current frame before returning
-    PMwrite ((uint64_t) (parent_frame) * PAGE_SIZE + parent_row_index, 0);
+    unlinkTableEntry (parent_frame, parent_row_index, current_frame);
     return current_frame;
   }
+  word_t rows[PAGE_SIZE];
+  PMreadFrame (current_frame, rows);
   for (uint64_t row = 0; row < PAGE_SIZE; row++)
   {
-    word_t next_frame = 0;
-    PMread ((uint64_t) (current_frame) * PAGE_SIZE + row, &next_frame);
+    word_t next_frame = PTE_FRAME (rows[row]);
     if (next_frame != PAGE_FAULT)
     {
       word_t candidate_empty_frame = getEmptyFrame (original_frame, next_frame,
@@ -114,10 +831,81 @@ word_t getEmptyFrame (word_t original_frame, word_t current_frame,
   return NO_FRAME_FOUND;
 }
 
+#if INDEXED_FRAME_SEARCH
+/*
+ * Computes the position of a table in the DFS order of getEmptyFrame:
+ * the rows along its path, left aligned to the depth of the tree.
+ */
+uint64_t getTablePathKey (word_t frame)
+{
+  return frame_table.page[frame]
+      << (OFFSET_WIDTH * (TABLES_DEPTH - frame_table.level[frame]));
+}
+
+word_t getIndexedEmptyFrame (word_t original_frame)
+{
+  //With a single space every table lies under the root
+  if (original_frame == ROOT_FRAME && space_count == 1)
+  {
+    return NO_FRAME_FOUND;
+  }
+  word_t empty_frame = NO_FRAME_FOUND;
+  uint64_t empty_frame_key = 0;
+  for (uint64_t summary = 0; summary < BITMAP_SUMMARY_WORDS; summary++)
+  {
+    uint64_t words = empty_table_words[summary];
+    while (words != 0)
+    {
+      uint64_t word = summary * BITMAP_WORD_BITS + __builtin_ctzll (words);
+      words &= words - 1;
+      uint64_t bits = empty_tables[word];
+      while (bits != 0)
+      {
+        word_t frame = (word_t) (word * BITMAP_WORD_BITS
+                                 + __builtin_ctzll (bits));
+        bits &= bits - 1;
+        //The DFS never enters the subtree of the original frame
+        if (original_frame != NO_FRAME_FOUND
+            && isUnderFrame (frame, original_frame))
+        {
+          continue;
+        }
+        uint64_t key = getTablePathKey (frame);
+        if (empty_frame == NO_FRAME_FOUND || key < empty_frame_key)
+        {
+          empty_frame = frame;
+          empty_frame_key = key;
+        }
+      }
+    }
+  }
+  if (empty_frame != NO_FRAME_FOUND)
+  {
+    //remove table reference to the frame before returning
+    unlinkTableEntry (frame_table.parent[empty_frame],
+                      frame_table.row[empty_frame], empty_frame);
+  }
+  return empty_frame;
+}
+#endif
+
 word_t searchForEmptyFrame (word_t original_frame)
 {
-  return getEmptyFrame (original_frame, ROOT_FRAME,
-                        ROOT_FRAME, 0, INITIAL_DEPTH_LEVEL);
+#if INDEXED_FRAME_SEARCH
+  return getIndexedEmptyFrame (original_frame);
+#else
+  for (uint64_t space = 0; space < space_count; space++)
+  {
+    word_t empty_frame = getEmptyFrame (original_frame, spaces[space].root,
+                                        spaces[space].root, 0,
+                                        INITIAL_DEPTH_LEVEL);
+    if (empty_frame != NO_FRAME_FOUND)
+    {
+      return empty_frame;
+    }
+  }
+  return NO_FRAME_FOUND;
+#endif
 }
 
 /*****************************************************************************
@@ -132,11 +920,12 @@ word_t getMaxFrame (word_t curr_frame_index, uint64_t depth_level)
   {
     return max_frame_index;
   }
+  word_t rows[PAGE_SIZE];
+  PMreadFrame (curr_frame_index, rows);
   for (uint64_t row = 0; row < PAGE_SIZE; row++)
   {
-    word_t next_frame = 0;
     //Get the pointer to the next frame
-    PMread (curr_frame_index * PAGE_SIZE + row, &next_frame);
+    word_t next_frame = PTE_FRAME (rows[row]);
     if (next_frame != PAGE_FAULT)
     {
       //Call getMaxFrame on next_frame
@@ -153,12 +942,31 @@ word_t getMaxFrame (word_t curr_frame_index, uint64_t depth_level)
 
 word_t searchForMaxFrame ()
 {
-  word_t max_frame_index = getMaxFrame (ROOT_FRAME, INITIAL_DEPTH_LEVEL);
+#if INDEXED_FRAME_SEARCH
+  //Frames reclaimed by Priority 1 and 3 are relinked by the same fault, so
+  //the linked frames are always exactly 0..frame_high_water
+  if (frame_high_water + 1 < NUM_FRAMES)
+  {
+    return ++frame_high_water;
+  }
+  return NO_FRAME_FOUND;
+#else
+  word_t max_frame_index = ROOT_FRAME;
+  for (uint64_t space = 0; space < space_count; space++)
+  {
+    word_t max_candidate = getMaxFrame (spaces[space].root,
+                                        INITIAL_DEPTH_LEVEL);
+    if (max_candidate > max_frame_index)
+    {
+      max_frame_index = max_candidate;
+    }
+  }
   if (max_frame_index + 1 < NUM_FRAMES)
   {
     return max_frame_index + 1;
   }
   return NO_FRAME_FOUND;
+#endif
 }
 
 /*****************************************************************************
@@ -170,17 +978,10 @@ typedef struct
     word_t parent;
     uint64_t child_offset;
     uint64_t page;
+    //Cyclic distance of the page plus one, so 0 means no page was found
     uint64_t distance;
 } SwapFrameData;
 
-uint64_t calculateCyclicalDistance (word_t swap_in_page, word_t page)
-{
-  uint64_t distance = (swap_in_page > page) ? (swap_in_page - page) : (page
-                                                                       - swap_in_page);
-  uint64_t cyclic = NUM_PAGES - distance;
-  return (cyclic < distance) ? cyclic : distance;
-}
-
 SwapFrameData searchFrameToEvict (uint64_t swap_in_page, word_t current_frame,
                                   word_t parent_frame, uint64_t
                                   parent_row_index, uint64_t page, uint64_t
@@ -188,15 +989,17 @@ SwapFrameData searchFrameToEvict (uint64_t swap_in_page, word_t current_frame,
 {
   if (depth_level == TABLES_DEPTH)
   {
-    uint64_t distance = calculateCyclicalDistance (swap_in_page, page);
+    uint64_t distance = calculateCyclicalDistance (keyPage (swap_in_page),
+                                                   keyPage (page)) + 1;
     return {parent_frame, parent_row_index, page, distance};
   }
   SwapFrameData swap_out_parent = {};
+  word_t rows[PAGE_SIZE];
+  PMreadFrame (current_frame, rows);
   for (uint64_t row = 0; row < PAGE_SIZE; row++)
   {
-    word_t next_frame = 0;
     uint64_t new_page = getNextPage (page, row);
-    PMread (current_frame * PAGE_SIZE + row, &next_frame);
+    word_t next_frame = PTE_FRAME (rows[row]);
     if (next_frame != PAGE_FAULT)
     {
       SwapFrameData candidate = searchFrameToEvict (swap_in_page, next_frame,
@@ -211,25 +1014,394 @@ SwapFrameData searchFrameToEvict (uint64_t swap_in_page, word_t current_frame,
   return swap_out_parent;
 }
 
+/*
+ * Clears a table entry and returns what it held. Concurrent translations
+ * may be setting flags in the entry, so it is swapped out atomically.
+ */
+word_t takeTableEntry (uint64_t pte_address)
+{
+  word_t entry = 0;
+  PMread (pte_address, &entry);
+#if CONCURRENT_VM
+  while (!PMcompareExchange (pte_address, &entry, PAGE_FAULT))
+  {}
+#endif
+  return entry;
+}
+
 word_t evictAndRemoveReference (SwapFrameData pair)
 {
-  word_t child = 0;
   //Find the evicted child
-  PMread (pair.parent * PAGE_SIZE + pair.child_offset, &child);
-  PMevict (child, pair.page);
-  //Remove reference
-  PMwrite (pair.parent * PAGE_SIZE + pair.child_offset, 0);
+  word_t entry = takeTableEntry (pair.parent * PAGE_SIZE + pair.child_offset);
+  word_t child = PTE_FRAME (entry);
+  //Remove reference before the page leaves the frame, so no access to it
+  //is still running by then
+  unlinkTableEntry (pair.parent, pair.child_offset, child);
+  //A page not written since it was restored may reuse its swap copy
+  if (entry & PTE_DIRTY)
+  {
+    PMevict (child, pair.page);
+  }
+  else
+  {
+    PMevictClean (child, pair.page);
+  }
+#if READAHEAD_MAX_WINDOW > 0
+  if (entry & PTE_PREFETCHED)
+  {
+    onReadaheadWasted (pair.page);
+  }
+#endif
+  spaceOf (pair.page).evictions++;
+  spaceOf (pair.page).resident_pages--;
+  policyOnEvict (pair.page);
+  tlbInvalidatePage (pair.page);
   return child;
 }
 
+#if !TREE_WALK_EVICTION
+/*
+ * Clears PTE_ACCESSED in the leaf entry of a resident page and returns
+ * whether it was set. TLB entries of the page still show the bit and would
+ * skip setting it again, so they are dropped.
+ */
+bool testAndClearAccessed (ResidentPage resident)
+{
+  word_t entry = 0;
+  PMread (resident.pte_address, &entry);
+  while (entry & PTE_ACCESSED)
+  {
+#if CONCURRENT_VM
+    //Translations may be setting flags in the entry meanwhile
+    if (!PMcompareExchange (resident.pte_address, &entry,
+                            entry & ~PTE_ACCESSED))
+    {
+      continue;
+    }
+    tlbShootdown ();
+#else
+    PMwrite (resident.pte_address, entry & ~PTE_ACCESSED);
+#endif
+    tlbInvalidatePage (resident.page);
+    return true;
+  }
+  return false;
+}
+#endif
+
+//Picks the page to swap out in favor of swap_in_page
+SwapFrameData selectVictimPage (uint64_t swap_in_page)
+{
+  selectVictimSpaces (keySpace (swap_in_page));
+#if TREE_WALK_EVICTION
+  //The page key of a root is its space, so the walk builds page keys
+  SwapFrameData parent_to_evict = {};
+  for (uint64_t space = 0; space < space_count; space++)
+  {
+    if (!isSpaceEvictable (space))
+    {
+      continue;
+    }
+    SwapFrameData candidate = searchFrameToEvict (swap_in_page,
+                                                  spaces[space].root,
+                                                  spaces[space].root, 0,
+                                                  space, INITIAL_DEPTH_LEVEL);
+    if (candidate.distance > parent_to_evict.distance)
+    {
+      parent_to_evict = candidate;
+    }
+  }
+#else
+  ResidentPage victim = {};
+  {
+    PolicyGuard guard;
+    victim = replacement_policy.selectVictim (swap_in_page, isSpaceEvictable,
+                                              testAndClearAccessed);
+  }
+  //The policy knows where the victim is mapped, so no walk is needed
+  SwapFrameData parent_to_evict = {(word_t) (victim.pte_address / PAGE_SIZE),
+                                   victim.pte_address % PAGE_SIZE,
+                                   victim.page, 0};
+#endif
+  return parent_to_evict;
+}
+
 word_t swapFrames(uint64_t swap_in_page){
-  SwapFrameData parent_to_evict = searchFrameToEvict (swap_in_page,
-                                                      ROOT_FRAME,
-                                                      ROOT_FRAME, 0, 0, INITIAL_DEPTH_LEVEL);
-  return evictAndRemoveReference (parent_to_evict);
+  return evictAndRemoveReference (selectVictimPage (swap_in_page));
+}
+
+/*****************************************************************************
+*                           Background Reclaim                               *
+*****************************************************************************/
+
+#if BACKGROUND_RECLAIM
+//Frames that are neither linked nor in use, taken by faults first
+word_t free_frames[RECLAIM_HIGH_WATERMARK];
+uint64_t free_frame_count = 0;
+//Set by the first fault that had to evict. From then on every frame is
+//linked or free, so Priority 2 has nothing left to give.
+bool frames_exhausted = false;
+//Refilling towards the high watermark, until nothing more can be freed
+bool reclaiming = false;
+bool reclaim_stalled = false;
+//Victims are chosen as if this page was being faulted in
+uint64_t reclaim_reference_page = 0;
+bool reclaimer_stopping = false;
+std::condition_variable reclaim_wanted;
+
+void resetReclaim ()
+{
+  free_frame_count = 0;
+  frames_exhausted = false;
+  reclaiming = false;
+  reclaim_stalled = false;
+  reclaim_reference_page = 0;
 }
 
+bool needsReclaim ()
+{
+  return frames_exhausted && !reclaim_stalled
+         && (reclaiming || free_frame_count < RECLAIM_LOW_WATERMARK);
+}
 
+/*
+ * Frees one frame into the pool, reclaiming an empty table if there is one
+ * and evicting a page by the configured policy otherwise.
+ * Returns false if neither is left.
+ */
+bool reclaimFrame ()
+{
+  word_t frame = searchForEmptyFrame (NO_FRAME_FOUND);
+  if (frame == NO_FRAME_FOUND)
+  {
+    bool has_pages = false;
+    for (uint64_t space = 0; space < space_count; space++)
+    {
+      has_pages = has_pages || spaces[space].resident_pages > 0;
+    }
+    if (!has_pages)
+    {
+      return false;
+    }
+    frame = swapFrames (reclaim_reference_page);
+  }
+  free_frames[free_frame_count++] = frame;
+  return true;
+}
+
+//Runs with fault_mutex held, and drops it between batches for the faults
+void reclaimLoop ()
+{
+  std::unique_lock<std::mutex> lock (fault_mutex);
+  while (true)
+  {
+    reclaim_wanted.wait (lock, [] {
+      return reclaimer_stopping || needsReclaim ();
+    });
+    if (reclaimer_stopping)
+    {
+      return;
+    }
+    reclaiming = true;
+    for (uint64_t batch = 0; batch < RECLAIM_BATCH && reclaiming; batch++)
+    {
+      if (!reclaimFrame ())
+      {
+        reclaim_stalled = true;
+        reclaiming = false;
+      }
+      else if (free_frame_count == RECLAIM_HIGH_WATERMARK)
+      {
+        reclaiming = false;
+      }
+    }
+    lock.unlock ();
+    std::this_thread::yield ();
+    lock.lock ();
+  }
+}
+
+//Started by the first VMinitialize and stopped when the program exits
+class Reclaimer
+{
+ public:
+  //Returns false if the thread was already running
+  bool start ()
+  {
+    if (thread.joinable ())
+    {
+      return false;
+    }
+    thread = std::thread (reclaimLoop);
+    return true;
+  }
+
+  void stop ()
+  {
+    if (thread.joinable ())
+    {
+      {
+        std::lock_guard<std::mutex> lock (fault_mutex);
+        reclaimer_stopping = true;
+      }
+      reclaim_wanted.notify_one ();
+      thread.join ();
+    }
+  }
+
+  ~Reclaimer ()
+  {
+    stop ();
+  }
+
+ private:
+  std::thread thread;
+};
+
+Reclaimer reclaimer;
+
+/*
+ * Registered with atexit when the thread starts. The thread evicts into
+ * the swap store of PhysicalMemory.cpp, whose destruction is not ordered
+ * against the objects of this file, but atexit handlers run before the
+ * destructors of every object constructed before them.
+ */
+void stopReclaimer ()
+{
+  reclaimer.stop ();
+}
+
+/*
+ * Hands a fault a frame from the pool. Frames in it are unlinked, so they
+ * are never on the path of the fault. Returns NO_FRAME_FOUND if the pool
+ * is empty.
+ */
+word_t takeFreeFrame (uint64_t page_number)
+{
+  reclaim_reference_page = page_number;
+  reclaim_stalled = false;
+  word_t frame = NO_FRAME_FOUND;
+  if (free_frame_count > 0)
+  {
+    frame = free_frames[--free_frame_count];
+  }
+  if (needsReclaim ())
+  {
+    reclaim_wanted.notify_one ();
+  }
+  return frame;
+}
+
+//Called when a fault has to evict by itself
+void onFramesExhausted ()
+{
+  frames_exhausted = true;
+  reclaim_wanted.notify_one ();
+}
+#endif
+
+/*****************************************************************************
+*                           Fused Fault Search                               *
+*****************************************************************************/
+
+typedef struct
+{
+    word_t original_frame;
+    uint64_t swap_in_page;
+    word_t empty_frame;
+    word_t empty_parent;
+    uint64_t empty_row;
+    word_t max_frame;
+    SwapFrameData victim;
+} FaultSearchState;
+
+/*
+ * Walks the tree once, tracking the max frame and the eviction victim, and
+ * stops at the first empty table in the order getEmptyFrame would find it.
+ * Tables under the original frame are walked but never reclaimed.
+ * Returns true if an empty table was found.
+ */
+bool fusedFaultSearch (FaultSearchState &state, word_t current_frame,
+                       word_t parent_frame, uint64_t parent_row_index,
+                       uint64_t page, uint64_t depth_level,
+                       bool under_original)
+{
+  if (current_frame > state.max_frame)
+  {
+    state.max_frame = current_frame;
+  }
+  if (depth_level == TABLES_DEPTH)
+  {
+    uint64_t distance = calculateCyclicalDistance (keyPage (state.swap_in_page),
+                                                   keyPage (page)) + 1;
+    if (isSpaceEvictable (keySpace (page)) && distance > state.victim.distance)
+    {
+      state.victim = {parent_frame, parent_row_index, page, distance};
+    }
+    return false;
+  }
+  under_original = under_original || current_frame == state.original_frame;
+  bool is_empty = true;
+  word_t rows[PAGE_SIZE];
+  PMreadFrame (current_frame, rows);
+  for (uint64_t row = 0; row < PAGE_SIZE; row++)
+  {
+    word_t next_frame = PTE_FRAME (rows[row]);
+    if (next_frame != PAGE_FAULT)
+    {
+      is_empty = false;
+      if (fusedFaultSearch (state, next_frame, current_frame, row,
+                            getNextPage (page, row), depth_level + 1,
+                            under_original))
+      {
+        return true;
+      }
+    }
+  }
+  if (is_empty && !under_original && depth_level != INITIAL_DEPTH_LEVEL)
+  {
+    state.empty_frame = current_frame;
+    state.empty_parent = parent_frame;
+    state.empty_row = parent_row_index;
+    return true;
+  }
+  return false;
+}
+
+word_t handleFusedPageFault (word_t current_frame, uint64_t page_number)
+{
+  FaultSearchState state = {current_frame, page_number, NO_FRAME_FOUND,
+                            ROOT_FRAME, 0, ROOT_FRAME, {}};
+  //The walk picks its victim among these spaces
+  selectVictimSpaces (keySpace (page_number));
+  //Priority 1
+  for (uint64_t space = 0; space < space_count; space++)
+  {
+    if (fusedFaultSearch (state, spaces[space].root, spaces[space].root, 0,
+                          space, INITIAL_DEPTH_LEVEL, false))
+    {
+      unlinkTableEntry (state.empty_parent, state.empty_row,
+                        state.empty_frame);
+      return state.empty_frame;
+    }
+  }
+
+  //Priority 2
+  if (state.max_frame + 1 < NUM_FRAMES)
+  {
+    return state.max_frame + 1;
+  }
+
+  //Priority 3
+#if BACKGROUND_RECLAIM
+  onFramesExhausted ();
+#endif
+#if TREE_WALK_EVICTION
+  return evictAndRemoveReference (state.victim);
+#else
+  return swapFrames (page_number);
+#endif
+}
 
 /*****************************************************************************
 *                            Page Fault Handler                              *
@@ -237,6 +1409,16 @@ word_t swapFrames(uint64_t swap_in_page){
 
 word_t handlePageFault (word_t current_frame, uint64_t page_number)
 {
+#if BACKGROUND_RECLAIM
+  word_t free_frame = takeFreeFrame (page_number);
+  if (free_frame != NO_FRAME_FOUND)
+  {
+    return free_frame;
+  }
+#endif
+#if !INDEXED_FRAME_SEARCH && FUSED_FAULT_HANDLER
+  return handleFusedPageFault (current_frame, page_number);
+#else
   //Priority 1
   word_t empty_frame_index = searchForEmptyFrame (current_frame);
   if (empty_frame_index != NO_FRAME_FOUND)
@@ -252,66 +1434,701 @@ word_t handlePageFault (word_t current_frame, uint64_t page_number)
   }
 
   //Priority 3
+#if BACKGROUND_RECLAIM
+  onFramesExhausted ();
+#endif
   return swapFrames (page_number);
+#endif
+}
+
+void createNewTable (word_t frame, uint64_t depth_level)
+{
+#if INDEXED_FRAME_SEARCH
+  frame_table.level[frame] = depth_level + 1;
+  frame_table.live_entries[frame] = 0;
+  frame_table.flags[frame] = (depth_level < TABLES_DEPTH - 1) ? FRAME_TABLE : 0;
+#endif
+  if (depth_level < TABLES_DEPTH - 1)
+  {
+    PMzeroFrame (frame);
+  }
+}
+
+/*
+ * Finds the frame for the page with page_key. A space holding as many pages
+ * as its quota allows replaces one of its own pages, even while other
+ * frames are free.
+ */
+word_t allocatePageFrame (word_t current_frame, uint64_t page_key)
+{
+  if (spaceOf (page_key).resident_pages >= spaceOf (page_key).max_pages)
+  {
+    return swapFrames (page_key);
+  }
+  return handlePageFault (current_frame, page_key);
+}
+
+#if !INDEXED_FRAME_SEARCH
+/*
+ * Finds the largest frame under frame. Returns false as soon as it meets
+ * an empty table, which a fault would reclaim before using a fresh frame.
+ */
+bool scanFreshFrames (word_t frame, uint64_t depth_level, word_t &max_frame)
+{
+  if (frame > max_frame)
+  {
+    max_frame = frame;
+  }
+  if (depth_level == TABLES_DEPTH)
+  {
+    return true;
+  }
+  bool is_empty = true;
+  word_t rows[PAGE_SIZE];
+  PMreadFrame (frame, rows);
+  for (uint64_t row = 0; row < PAGE_SIZE; row++)
+  {
+    word_t next_frame = PTE_FRAME (rows[row]);
+    if (next_frame != PAGE_FAULT)
+    {
+      is_empty = false;
+      if (!scanFreshFrames (next_frame, depth_level + 1, max_frame))
+      {
+        return false;
+      }
+    }
+  }
+  return !is_empty || depth_level == INITIAL_DEPTH_LEVEL;
+}
+#endif
+
+/*
+ * Takes up to count frames that were never used, for the missing levels of
+ * one fault, and returns the first of them. The frames are consecutive and
+ * their number is left in taken. Frames are only taken while no table can
+ * be reclaimed, as a fault on each level would then have taken the frame
+ * after the largest one, in the same order.
+ */
+word_t takeFreshFrames (uint64_t count, uint64_t &taken)
+{
+  taken = 0;
+#if BACKGROUND_RECLAIM
+  //Frames past the tables may be waiting in the free pool
+  if (frames_exhausted)
+  {
+    return NO_FRAME_FOUND;
+  }
+#endif
+  word_t max_frame = ROOT_FRAME;
+#if INDEXED_FRAME_SEARCH
+  for (uint64_t summary = 0; summary < BITMAP_SUMMARY_WORDS; summary++)
+  {
+    if (empty_table_words[summary] != 0)
+    {
+      return NO_FRAME_FOUND;
+    }
+  }
+  max_frame = frame_high_water;
+#else
+  if (fresh_frames_exhausted)
+  {
+    return NO_FRAME_FOUND;
+  }
+  for (uint64_t space = 0; space < space_count; space++)
+  {
+    if (!scanFreshFrames (spaces[space].root, INITIAL_DEPTH_LEVEL, max_frame))
+    {
+      return NO_FRAME_FOUND;
+    }
+  }
+#endif
+  uint64_t available = NUM_FRAMES - 1 - max_frame;
+  taken = (count < available) ? count : available;
+#if INDEXED_FRAME_SEARCH
+  frame_high_water += taken;
+#else
+  fresh_frames_exhausted = taken == available;
+#endif
+  return max_frame + 1;
+}
+
+/*
+ * Maps the levels of virtual_address from depth_level down, all of which
+ * are missing below curr_frame, and returns the frame of the page. Fresh
+ * frames for the whole path are found in one pass, and any level left
+ * over searches on its own with the table above it as the frame it must
+ * not take, so no frame on the path is ever reclaimed or evicted.
+ */
+word_t mapMissingLevels (uint64_t virtual_address, uint64_t page_key,
+                         word_t curr_frame, uint64_t depth_level,
+                         uint64_t &pte_address, word_t &entry,
+                         bool &leaf_fault)
+{
+  //A space at its quota replaces one of its own pages for the leaf
+  bool leaf_replaces = spaceOf (page_key).resident_pages
+                       >= spaceOf (page_key).max_pages;
+  uint64_t fresh_count = 0;
+  word_t fresh_frame = takeFreshFrames (
+      TABLES_DEPTH - depth_level - (leaf_replaces ? 1 : 0), fresh_count);
+  for (uint64_t level = depth_level; level < TABLES_DEPTH; level++)
+  {
+    bool is_leaf = level == TABLES_DEPTH - 1;
+    uint64_t page_index = calculateBits (virtual_address, PAGE_INDEX, level);
+    pte_address = (uint64_t) (curr_frame) * PAGE_SIZE + page_index;
+    word_t next_frame = NO_FRAME_FOUND;
+    if (fresh_count > 0)
+    {
+      next_frame = fresh_frame++;
+      fresh_count--;
+    }
+    else
+    {
+      next_frame = (is_leaf) ? allocatePageFrame (curr_frame, page_key)
+                             : handlePageFault (curr_frame, page_key);
+    }
+    createNewTable (next_frame, level);
+    //The frame is filled before it is linked, where readers may find it
+    if (is_leaf)
+    {
+      PMrestore (next_frame, page_key);
+    }
+    linkTableEntry (curr_frame, page_index, next_frame, 0);
+    entry = next_frame;
+    curr_frame = next_frame;
+  }
+  policyOnFault (page_key, pte_address);
+  spaceOf (page_key).page_faults++;
+  spaceOf (page_key).resident_pages++;
+  leaf_fault = true;
+  return curr_frame;
+}
+
+/*
+ * Turns frame into the empty root table of space.
+ */
+void createSpaceRoot (word_t frame, space_t space)
+{
+#if INDEXED_FRAME_SEARCH
+  frame_table.parent[frame] = frame;
+  frame_table.row[frame] = 0;
+  frame_table.level[frame] = INITIAL_DEPTH_LEVEL;
+  frame_table.page[frame] = space;
+  frame_table.live_entries[frame] = 0;
+  frame_table.flags[frame] = FRAME_LINKED | FRAME_TABLE;
+#endif
+  PMzeroFrame (frame);
+  spaces[space] = emptySpace (frame);
 }
 
 /*****************************************************************************
-*                     Translate to Physical Address                          *
+*                                Readahead                                   *
 *****************************************************************************/
 
-void createNewTable (word_t frame, uint64_t depth_level)
+#if READAHEAD_MAX_WINDOW > 0
+//Pages of one fault and its read ahead, and what they may still evict
+typedef struct
 {
-  if (depth_level < TABLES_DEPTH - 1)
+    //The faulting page followed by the pages read ahead for it
+    uint64_t pages[READAHEAD_MAX_WINDOW + 1];
+    uint64_t count;
+    //Pages the burst may still evict to make room
+    uint64_t evictions_left;
+} ReadaheadBurst;
+
+bool isBurstPage (const ReadaheadBurst &burst, uint64_t page_key)
+{
+  for (uint64_t page = 0; page < burst.count; page++)
   {
-    for (uint64_t row = 0; row < PAGE_SIZE; row++)
+    if (burst.pages[page] == page_key)
     {
-      PMwrite ((uint64_t) (frame) * PAGE_SIZE + row, 0);
+      return true;
     }
   }
+  return false;
 }
 
-void translateVirtualAddress (uint64_t virtualAddress, uint64_t &
-physical_address)
+/*
+ * Finds a frame for a missing level of a read ahead page, or returns
+ * NO_FRAME_FOUND to end the burst. Once memory is full, frames come from
+ * the pool of the reclaimer, and then from evicting the victim of the
+ * policy, up to the budget of the burst. A victim that belongs to the
+ * burst ends it instead, so read ahead never pushes out the faulting page
+ * or the pages it just read. Tables are never evicted, so the paths of
+ * those pages stay in place.
+ */
+word_t findReadaheadFrame (word_t curr_frame, uint64_t page_key,
+                           ReadaheadBurst &burst)
 {
-  uint64_t page_number = calculateBits (virtualAddress, PAGE_NUMBER);
-  word_t curr_frame = ROOT_FRAME;
+  word_t frame = searchForEmptyFrame (curr_frame);
+  bool may_extend = true;
+#if BACKGROUND_RECLAIM
+  //Once memory ran out, frames past the tables may be in the free pool
+  may_extend = !frames_exhausted;
+#endif
+  if (frame == NO_FRAME_FOUND && may_extend)
+  {
+    frame = searchForMaxFrame ();
+  }
+#if BACKGROUND_RECLAIM
+  if (frame == NO_FRAME_FOUND)
+  {
+    frame = takeFreeFrame (burst.pages[0]);
+  }
+#endif
+  if (frame == NO_FRAME_FOUND && burst.evictions_left > 0)
+  {
+    SwapFrameData victim = selectVictimPage (page_key);
+    if (!isBurstPage (burst, victim.page))
+    {
+      burst.evictions_left--;
+#if BACKGROUND_RECLAIM
+      onFramesExhausted ();
+#endif
+      frame = evictAndRemoveReference (victim);
+    }
+  }
+  return frame;
+}
+
+/*
+ * Maps the page with page_key into empty tables and unused frames, or into
+ * frames evicted within the budget of the burst. Records the page in the
+ * burst, so later pages of it never evict it. Returns false if the page
+ * could not be mapped.
+ */
+bool readPageAhead (uint64_t page_key, ReadaheadBurst &burst)
+{
+  //Read ahead never pushes a space past its quota
+  if (spaceOf (page_key).resident_pages >= spaceOf (page_key).max_pages)
+  {
+    return false;
+  }
+  uint64_t virtual_address = keyPage (page_key) << OFFSET_WIDTH;
+  word_t curr_frame = spaceOf (page_key).root;
   for (uint64_t level = 0; level < TABLES_DEPTH; level++)
   {
-    uint64_t page_index = calculateBits (virtualAddress, PAGE_INDEX, level);
+    uint64_t page_index = calculateBits (virtual_address, PAGE_INDEX, level);
     word_t next_frame = 0;
     PMread ((uint64_t) (curr_frame) * PAGE_SIZE + page_index, &next_frame);
+    next_frame = PTE_FRAME (next_frame);
     if (next_frame == PAGE_FAULT)
     {
-      next_frame = handlePageFault (curr_frame, page_number);
+      next_frame = findReadaheadFrame (curr_frame, page_key, burst);
+      if (next_frame == NO_FRAME_FOUND)
+      {
+        return false;
+      }
       createNewTable (next_frame, level);
-      PMwrite ((uint64_t) (curr_frame) * PAGE_SIZE + page_index, next_frame);
       if (level == TABLES_DEPTH - 1)
       {
-        PMrestore (next_frame, page_number);
+        PMrestore (next_frame, page_key);
+      }
+      //Marked until the first access, which tells read ahead pages apart
+      linkTableEntry (curr_frame, page_index, next_frame,
+                      (level == TABLES_DEPTH - 1) ? PTE_PREFETCHED : 0);
+      if (level == TABLES_DEPTH - 1)
+      {
+        policyOnFault (page_key,
+                       (uint64_t) (curr_frame) * PAGE_SIZE + page_index);
+        spaceOf (page_key).resident_pages++;
+        readahead_issued++;
       }
     }
     curr_frame = next_frame;
   }
+  //Pages of the stream that were already resident are kept as well
+  burst.pages[burst.count++] = page_key;
+  return true;
+}
+
+/*
+ * Called on every page fault. Two faults in a row of a space with the same
+ * stride start a stream, and every further fault on it reads the next
+ * pages ahead. The window doubles while read ahead pages are used and
+ * halves when most of them are evicted unused.
+ */
+void onPageFault (uint64_t page_key)
+{
+  StreamDetector &stream = spaceOf (page_key).stream;
+  int64_t stride = (int64_t) page_key - (int64_t) stream.last_page;
+  bool on_stream = stride != 0 && stride == stream.stride;
+  stream.stride = stride;
+  stream.last_page = page_key;
+  if (!on_stream)
+  {
+    return;
+  }
+
+  //Concurrent translations count used pages while the fault runs
+  uint64_t recent_useful = __atomic_exchange_n (&stream.recent_useful, 0,
+                                                __ATOMIC_RELAXED);
+  if (stream.recent_wasted > recent_useful)
+  {
+    stream.window = (stream.window / 2 > READAHEAD_MIN_WINDOW)
+                    ? stream.window / 2 : READAHEAD_MIN_WINDOW;
+  }
+  else if (recent_useful > 0 || stream.recent_wasted == 0)
+  {
+    stream.window = (stream.window * 2 < READAHEAD_MAX_WINDOW)
+                    ? stream.window * 2 : READAHEAD_MAX_WINDOW;
+  }
+  stream.recent_wasted = 0;
+
+  //Each page read ahead may displace one page once memory is full
+  ReadaheadBurst burst = {{page_key}, 1, stream.window};
+  //The stream stays inside the space of the faulting page
+  uint64_t space = keySpace (page_key);
+  for (uint64_t ahead = 1; ahead <= stream.window; ahead++)
+  {
+    int64_t next_page = (int64_t) keyPage (page_key) + stride * (int64_t) ahead;
+    if (next_page < 0 || next_page >= NUM_PAGES
+        || !readPageAhead (pageKey (space, (uint64_t) next_page), burst))
+    {
+      break;
+    }
+    stream.last_page = pageKey (space, (uint64_t) next_page);
+  }
+}
+#endif
+
+/*****************************************************************************
+*                     Translate to Physical Address                          *
+*****************************************************************************/
+
+#if CONCURRENT_VM
+/*
+ * Walks the tables of a resident page without changing them.
+ * Returns false if a table or the page itself is missing.
+ */
+bool lookupResidentPage (uint64_t virtual_address, word_t root,
+                         uint64_t &pte_address, word_t &entry)
+{
+  word_t curr_frame = root;
+  for (uint64_t level = 0; level < TABLES_DEPTH; level++)
+  {
+    pte_address = (uint64_t) (curr_frame) * PAGE_SIZE
+                  + calculateBits (virtual_address, PAGE_INDEX, level);
+    PMread (pte_address, &entry);
+    curr_frame = PTE_FRAME (entry);
+    if (curr_frame == PAGE_FAULT)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Sets access_flags in a leaf entry that other threads may update at the
+ * same time, and leaves the entry as it was before in entry. Fails if the
+ * entry no longer maps the frame it mapped when it was read, which is how
+ * a walk finds out that a fault took the page out under it.
+ */
+bool setLeafFlags (uint64_t pte_address, word_t &entry, uint64_t page_key,
+                   word_t access_flags)
+{
+  word_t current = entry;
+  while ((current & access_flags) != access_flags)
+  {
+    if (PMcompareExchange (pte_address, &current,
+                           PTE_AFTER_ACCESS (current, access_flags)))
+    {
+      //Only the thread that sets PTE_DIRTY drops the swap copy
+      if ((access_flags & ~current) & PTE_DIRTY)
+      {
+        PMdiscard (page_key);
+      }
+      break;
+    }
+    if (PTE_FRAME (current) != PTE_FRAME (entry))
+    {
+      return false;
+    }
+  }
+  entry = current;
+  return true;
+}
+
+/*
+ * Translates a resident page without locking, from the TLB of the thread
+ * or by walking the tables, and leaves the TLB entry in translation.
+ * Returns false if the page has to be faulted in.
+ */
+bool translateResidentPage (uint64_t virtual_address, uint64_t page_key,
+                            word_t access_flags, TlbEntry *&translation)
+{
+  if (translation != nullptr)
+  {
+    word_t entry = translation->frame | translation->pte_flags;
+    if (setLeafFlags (translation->pte_address, entry, page_key,
+                      access_flags))
+    {
+      translation->pte_flags = PTE_AFTER_ACCESS (entry, access_flags)
+                               & PTE_FLAGS;
+      return true;
+    }
+    //The page was taken out after the TLB was last synchronized
+    translation->valid = false;
+    translation = nullptr;
+    return false;
+  }
+  uint64_t pte_address = 0;
+  word_t entry = 0;
+  if (!lookupResidentPage (virtual_address, spaceOf (page_key).root,
+                           pte_address, entry)
+      || !setLeafFlags (pte_address, entry, page_key, access_flags))
+  {
+    return false;
+  }
+#if READAHEAD_MAX_WINDOW > 0
+  //Only the access that cleared the mark counts the page as used
+  if (entry & PTE_PREFETCHED)
+  {
+    onReadaheadUsed (page_key);
+  }
+#endif
+  translation = tlbInsert (page_key, PTE_FRAME (entry), pte_address,
+                           PTE_AFTER_ACCESS (entry, access_flags) & PTE_FLAGS);
+  return true;
+}
+#endif
+
+/*
+ * Sets access_flags in the leaf entry of a translation, skipping the write
+ * when the TLB entry shows they are already set.
+ */
+void markPageAccess (TlbEntry *translation, word_t access_flags)
+{
+  if ((translation->pte_flags & access_flags) == access_flags)
+  {
+    return;
+  }
+#if CONCURRENT_VM
+  //The fault lock keeps the page in place, so this cannot fail
+  word_t entry = translation->frame | translation->pte_flags;
+  setLeafFlags (translation->pte_address, entry, translation->page,
+                access_flags);
+#if READAHEAD_MAX_WINDOW > 0
+  //Only the access that cleared the mark counts the page as used
+  if (entry & PTE_PREFETCHED)
+  {
+    onReadaheadUsed (translation->page);
+  }
+#endif
+  translation->pte_flags = PTE_AFTER_ACCESS (entry, access_flags) & PTE_FLAGS;
+  return;
+#endif
+#if READAHEAD_MAX_WINDOW > 0
+  if (translation->pte_flags & PTE_PREFETCHED)
+  {
+    onReadaheadUsed (translation->page);
+  }
+#endif
+  //The first write after a restore makes the swap copy stale
+  if ((access_flags & ~translation->pte_flags) & PTE_DIRTY)
+  {
+    PMdiscard (translation->page);
+  }
+  translation->pte_flags = PTE_AFTER_ACCESS (translation->pte_flags,
+                                             access_flags);
+  PMwrite (translation->pte_address,
+           translation->frame | translation->pte_flags);
+}
+
+/*
+ * Translates virtualAddress for an access with access_flags. The frame
+ * stays in place as long as guard is held.
+ */
+void translateVirtualAddress (uint64_t virtualAddress, uint64_t &
+physical_address, word_t access_flags, AccessGuard &guard)
+{
+  uint64_t page_key = pageKey (currentSpace (),
+                               calculateBits (virtualAddress, PAGE_NUMBER));
   uint64_t offset = calculateBits (virtualAddress, OFFSET);
-  physical_address = curr_frame * PAGE_SIZE + offset;
+  policyOnAccess (page_key);
+  TlbEntry *translation = tlbLookup (page_key);
+#if CONCURRENT_VM
+  //Resident pages are translated optimistically, and any translation the
+  //leaf entry does not confirm falls back to the fault path
+  if (translateResidentPage (virtualAddress, page_key, access_flags,
+                             translation))
+  {
+    physical_address = translation->frame * PAGE_SIZE + offset;
+    return;
+  }
+  guard.leave ();
+  WriterGuard writer;
+  //Faults of other threads may have run since the lookup
+  tlbSynchronize ();
+  policyFlushAccesses ();
+#else
+  (void) guard;
+#endif
+  bool leaf_fault = false;
+  if (translation == nullptr)
+  {
+    uint64_t pte_address = 0;
+    word_t entry = 0;
+    word_t curr_frame = spaceOf (page_key).root;
+    for (uint64_t level = 0; level < TABLES_DEPTH; level++)
+    {
+      uint64_t page_index = calculateBits (virtualAddress, PAGE_INDEX, level);
+      pte_address = (uint64_t) (curr_frame) * PAGE_SIZE + page_index;
+      PMread (pte_address, &entry);
+      word_t next_frame = PTE_FRAME (entry);
+      if (next_frame == PAGE_FAULT)
+      {
+        //Every level below a missing table is missing as well
+        curr_frame = mapMissingLevels (virtualAddress, page_key, curr_frame,
+                                       level, pte_address, entry, leaf_fault);
+        break;
+      }
+      curr_frame = next_frame;
+    }
+    translation = tlbInsert (page_key, curr_frame, pte_address,
+                             entry & PTE_FLAGS);
+  }
+  markPageAccess (translation, access_flags);
+  physical_address = translation->frame * PAGE_SIZE + offset;
+#if READAHEAD_MAX_WINDOW > 0
+  if (leaf_fault)
+  {
+    onPageFault (page_key);
+  }
+#else
+  (void) leaf_fault;
+#endif
+#if CONCURRENT_VM
+  //The frames this fault took out were invalidated in the TLB of the
+  //thread, so it keeps its entries
+  tlb_seen_generation = tlb_generation.load (std::memory_order_relaxed);
+  //Entered before the fault lock is released, so no later fault can take
+  //the page out from under the caller
+  guard.enter ();
+#endif
 }
 
 /*****************************************************************************
 *                                  API                                       *
 *****************************************************************************/
 
+//Set by VMinitialize, every access fails while the RAM is not mapped
+bool ram_mapped = false;
+
 void VMinitialize ()
 {
+  WriterGuard guard;
+  ram_mapped = PMinitialize ();
+  if (!ram_mapped)
+  {
+    return;
+  }
+  tlbFlush ();
+  policyReset ();
+#if READAHEAD_MAX_WINDOW > 0
+  resetReadahead ();
+#endif
   //Initialize Frame 0 with rows equal to 0
-  for (uint64_t row = 0; row < PAGE_SIZE; row++)
+  PMzeroFrame (ROOT_FRAME);
+  resetFrameBookkeeping ();
+  resetSpaces ();
+#if BACKGROUND_RECLAIM
+  resetReclaim ();
+  if (reclaimer.start ())
+  {
+    std::atexit (stopReclaimer);
+  }
+#endif
+}
+
+int VMcreateSpace (space_t *space)
+{
+  WriterGuard guard;
+  //Roots stay in memory, and a fault in any space may still need a frame
+  //for every level of its tables
+  if (!ram_mapped || space == nullptr || space_count == MAX_SPACES
+      || space_count + 1 + TABLES_DEPTH > NUM_FRAMES)
+  {
+    return FAILURE_RET_VAL;
+  }
+  //No table is being walked, so every priority may be used. The new space
+  //has no pages yet, so it is never asked to give one up.
+  spaces[space_count] = emptySpace (ROOT_FRAME);
+  word_t root = handlePageFault (NO_FRAME_FOUND, pageKey (space_count, 0));
+  createSpaceRoot (root, space_count);
+  *space = space_count;
+  __atomic_store_n (&space_count, space_count + 1, __ATOMIC_RELEASE);
+  return SUCCESS_RET_VAL;
+}
+
+int VMswitchSpace (space_t space)
+{
+  //The current space belongs to the thread, so only the id is shared
+  if (space >= __atomic_load_n (&space_count, __ATOMIC_ACQUIRE))
+  {
+    return FAILURE_RET_VAL;
+  }
+  //TLB entries are tagged with the space, so nothing has to be flushed
+  current_space = space;
+#if CONCURRENT_VM
+  space_seen_generation = space_reset_generation.load (
+      std::memory_order_acquire);
+#endif
+  return SUCCESS_RET_VAL;
+}
+
+space_t VMcurrentSpace ()
+{
+  return currentSpace ();
+}
+
+int VMsetSpaceQuota (space_t space, uint64_t min_pages, uint64_t max_pages)
+{
+  WriterGuard guard;
+  if (space >= space_count || max_pages == 0 || min_pages > max_pages)
+  {
+    return FAILURE_RET_VAL;
+  }
+  //The minimums must leave room for the roots and a full path of tables
+  uint64_t reserved = min_pages;
+  for (uint64_t other = 0; other < space_count; other++)
+  {
+    reserved += (other == space) ? 0 : spaces[other].min_pages;
+  }
+  if (reserved + space_count + TABLES_DEPTH > NUM_FRAMES)
+  {
+    return FAILURE_RET_VAL;
+  }
+  spaces[space].min_pages = min_pages;
+  spaces[space].max_pages = max_pages;
+  return SUCCESS_RET_VAL;
+}
+
+int VMsetSpaceWeight (space_t space, uint64_t weight)
+{
+  WriterGuard guard;
+  if (space >= space_count || weight == 0)
+  {
+    return FAILURE_RET_VAL;
+  }
+  spaces[space].weight = weight;
+  return SUCCESS_RET_VAL;
+}
+
+int VMsetReplacementScope (int scope)
+{
+  WriterGuard guard;
+  if (scope != GLOBAL_REPLACEMENT && scope != FAIR_REPLACEMENT)
   {
-    PMwrite (row, 0);
+    return FAILURE_RET_VAL;
   }
+  replacement_scope = scope;
+  return SUCCESS_RET_VAL;
 }
 
 int VMread (uint64_t virtualAddress, word_t *value)
 {
-  if (virtualAddress >= VIRTUAL_MEMORY_SIZE)
+  if (!ram_mapped || virtualAddress >= VIRTUAL_MEMORY_SIZE)
   {
     return FAILURE_RET_VAL;
   }
@@ -319,20 +2136,248 @@ int VMread (uint64_t virtualAddress, word_t *value)
   {
     return FAILURE_RET_VAL;
   }
+  AccessGuard guard;
   uint64_t physical_address;
-  translateVirtualAddress (virtualAddress, physical_address);
+  translateVirtualAddress (virtualAddress, physical_address, PTE_ACCESSED,
+                           guard);
   PMread (physical_address, value);
   return SUCCESS_RET_VAL;
 }
 
 int VMwrite (uint64_t virtualAddress, word_t value)
 {
-  if (virtualAddress >= VIRTUAL_MEMORY_SIZE)
+  if (!ram_mapped || virtualAddress >= VIRTUAL_MEMORY_SIZE)
   {
     return FAILURE_RET_VAL;
   }
+  AccessGuard guard;
   uint64_t physical_address;
-  translateVirtualAddress (virtualAddress, physical_address);
+  translateVirtualAddress (virtualAddress, physical_address,
+                           PTE_ACCESSED | PTE_DIRTY, guard);
   PMwrite (physical_address, value);
   return SUCCESS_RET_VAL;
 }
+
+/*
+ * Translates each page touched by the range once and copies the run of
+ * words that falls inside it.
+ */
+int VMreadRange (uint64_t virtualAddress, word_t *values, uint64_t count)
+{
+  if (!ram_mapped || values == nullptr
+      || virtualAddress >= VIRTUAL_MEMORY_SIZE
+      || count > VIRTUAL_MEMORY_SIZE - virtualAddress)
+  {
+    return FAILURE_RET_VAL;
+  }
+  AccessGuard guard;
+  uint64_t done = 0;
+  while (done < count)
+  {
+    uint64_t address = virtualAddress + done;
+    uint64_t run = PAGE_SIZE - calculateBits (address, OFFSET);
+    run = (run < count - done) ? run : count - done;
+    uint64_t physical_address;
+    translateVirtualAddress (address, physical_address, PTE_ACCESSED, guard);
+    if (run == PAGE_SIZE)
+    {
+      PMreadFrame (physical_address / PAGE_SIZE, &values[done]);
+    }
+    else
+    {
+      for (uint64_t word = 0; word < run; word++)
+      {
+        PMread (physical_address + word, &values[done + word]);
+      }
+    }
+    done += run;
+  }
+  return SUCCESS_RET_VAL;
+}
+
+int VMwriteRange (uint64_t virtualAddress, const word_t *values,
+                  uint64_t count)
+{
+  if (!ram_mapped || values == nullptr
+      || virtualAddress >= VIRTUAL_MEMORY_SIZE
+      || count > VIRTUAL_MEMORY_SIZE - virtualAddress)
+  {
+    return FAILURE_RET_VAL;
+  }
+  AccessGuard guard;
+  uint64_t done = 0;
+  while (done < count)
+  {
+    uint64_t address = virtualAddress + done;
+    uint64_t run = PAGE_SIZE - calculateBits (address, OFFSET);
+    run = (run < count - done) ? run : count - done;
+    uint64_t physical_address;
+    translateVirtualAddress (address, physical_address,
+                             PTE_ACCESSED | PTE_DIRTY, guard);
+    if (run == PAGE_SIZE)
+    {
+      PMwriteFrame (physical_address / PAGE_SIZE, &values[done]);
+    }
+    else
+    {
+      for (uint64_t word = 0; word < run; word++)
+      {
+        PMwrite (physical_address + word, values[done + word]);
+      }
+    }
+    done += run;
+  }
+  return SUCCESS_RET_VAL;
+}
+
+/*
+ * Returns the positions of the addresses grouped by page, keeping the
+ * original order inside each page, or an empty vector if any address is
+ * out of range.
+ */
+std::vector<uint64_t> groupByPage (const uint64_t *addresses, uint64_t count)
+{
+  std::vector<uint64_t> order;
+  for (uint64_t i = 0; i < count; i++)
+  {
+    if (addresses[i] >= VIRTUAL_MEMORY_SIZE)
+    {
+      return std::vector<uint64_t> ();
+    }
+  }
+  order.resize (count);
+  for (uint64_t i = 0; i < count; i++)
+  {
+    order[i] = i;
+  }
+  std::stable_sort (order.begin (), order.end (),
+                    [addresses] (uint64_t first, uint64_t second)
+                    {
+                        return calculateBits (addresses[first], PAGE_NUMBER)
+                               < calculateBits (addresses[second],
+                                                PAGE_NUMBER);
+                    });
+  return order;
+}
+
+int VMgather (const uint64_t *addresses, word_t *values, uint64_t count)
+{
+  if (!ram_mapped || addresses == nullptr || values == nullptr)
+  {
+    return FAILURE_RET_VAL;
+  }
+  std::vector<uint64_t> order = groupByPage (addresses, count);
+  if (order.size () != count)
+  {
+    return FAILURE_RET_VAL;
+  }
+  AccessGuard guard;
+  uint64_t i = 0;
+  while (i < count)
+  {
+    uint64_t page_number = calculateBits (addresses[order[i]], PAGE_NUMBER);
+    uint64_t physical_address;
+    translateVirtualAddress (addresses[order[i]], physical_address,
+                             PTE_ACCESSED, guard);
+    uint64_t frame_address = physical_address
+                             - calculateBits (addresses[order[i]], OFFSET);
+    for (; i < count
+           && calculateBits (addresses[order[i]], PAGE_NUMBER) == page_number;
+           i++)
+    {
+      PMread (frame_address + calculateBits (addresses[order[i]], OFFSET),
+              &values[order[i]]);
+    }
+  }
+  return SUCCESS_RET_VAL;
+}
+
+int VMscatter (const uint64_t *addresses, const word_t *values,
+               uint64_t count)
+{
+  if (!ram_mapped || addresses == nullptr || values == nullptr)
+  {
+    return FAILURE_RET_VAL;
+  }
+  std::vector<uint64_t> order = groupByPage (addresses, count);
+  if (order.size () != count)
+  {
+    return FAILURE_RET_VAL;
+  }
+  AccessGuard guard;
+  uint64_t i = 0;
+  while (i < count)
+  {
+    uint64_t page_number = calculateBits (addresses[order[i]], PAGE_NUMBER);
+    uint64_t physical_address;
+    translateVirtualAddress (addresses[order[i]], physical_address,
+                             PTE_ACCESSED | PTE_DIRTY, guard);
+    uint64_t frame_address = physical_address
+                             - calculateBits (addresses[order[i]], OFFSET);
+    for (; i < count
+           && calculateBits (addresses[order[i]], PAGE_NUMBER) == page_number;
+           i++)
+    {
+      PMwrite (frame_address + calculateBits (addresses[order[i]], OFFSET),
+               values[order[i]]);
+    }
+  }
+  return SUCCESS_RET_VAL;
+}
+
+uint64_t VMtlbHits ()
+{
+  return tlb_hits;
+}
+
+uint64_t VMtlbMisses ()
+{
+  return tlb_misses;
+}
+
+uint64_t VMreadaheadIssued ()
+{
+#if READAHEAD_MAX_WINDOW > 0
+  WriterGuard guard;
+  return readahead_issued;
+#else
+  return 0;
+#endif
+}
+
+uint64_t VMreadaheadUseful ()
+{
+#if READAHEAD_MAX_WINDOW > 0
+  return __atomic_load_n (&readahead_useful, __ATOMIC_RELAXED);
+#else
+  return 0;
+#endif
+}
+
+uint64_t VMspacePageFaults (space_t space)
+{
+  WriterGuard guard;
+  return (space < space_count) ? spaces[space].page_faults : 0;
+}
+
+uint64_t VMspaceEvictions (space_t space)
+{
+  WriterGuard guard;
+  return (space < space_count) ? spaces[space].evictions : 0;
+}
+
+uint64_t VMspaceResidentPages (space_t space)
+{
+  WriterGuard guard;
+  return (space < space_count) ? spaces[space].resident_pages : 0;
+}
+
+uint64_t VMfreeFrames ()
+{
+#if BACKGROUND_RECLAIM
+  WriterGuard guard;
+  return free_frame_count;
+#else
+  return 0;
+#endif
+}
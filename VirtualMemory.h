@@ -2,11 +2,95 @@
 
 #include "MemoryConstants.h"
 
+// identifies an address space
+typedef uint64_t space_t;
+
+// the space set up by VMinitialize
+#define DEFAULT_SPACE 0
+
+// maximum number of pages of a space without a quota
+#define UNLIMITED_PAGES UINT64_MAX
+
+// a fault may evict a page of any space above its minimum
+#define GLOBAL_REPLACEMENT 0
+// a fault evicts a page of the space furthest above its weighted share
+#define FAIR_REPLACEMENT 1
+
+// free frames ahead of faults on a background thread once memory runs out
+#ifndef BACKGROUND_RECLAIM
+#define BACKGROUND_RECLAIM 0
+#endif
+// free frames below which reclaim starts, and up to which it refills
+#ifndef RECLAIM_LOW_WATERMARK
+#define RECLAIM_LOW_WATERMARK (NUM_FRAMES / 64 + 1)
+#endif
+#ifndef RECLAIM_HIGH_WATERMARK
+#define RECLAIM_HIGH_WATERMARK (2 * RECLAIM_LOW_WATERMARK)
+#endif
+
 /*
  * Initialize the virtual memory.
+ * Leaves only DEFAULT_SPACE, which becomes the current space of every
+ * thread.
+ * With CONCURRENT_VM every other function may be called from any number
+ * of threads at once, and each thread has its own current space. At most
+ * READER_EPOCH_SLOTS (64) calls access the memory at the same time, and
+ * further calls wait for one of them to return. This one must not run
+ * alongside any of them.
+ * If the physical memory cannot be mapped, every function below that
+ * accesses memory returns 0.
  */
 void VMinitialize();
 
+/* Creates an empty address space that shares the physical memory with the
+ * other spaces, and puts its handle in *space. The root table of the space
+ * takes a frame for as long as the space exists.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if MAX_SPACES spaces exist, or the RAM is too small
+ * to hold another root next to a full path of tables)
+ */
+int VMcreateSpace(space_t* space);
+
+/* Makes the given space the one VMread, VMwrite and the range and
+ * scatter/gather functions work on.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if there is no such space)
+ */
+int VMswitchSpace(space_t space);
+
+/* Returns the space VMread and VMwrite currently work on.
+ */
+space_t VMcurrentSpace();
+
+/* Sets the number of pages of the given space that stay in memory when
+ * other spaces fault, and the number of pages the space may hold at once.
+ * A space holding max_pages pages replaces its own pages on a fault.
+ * New spaces have no minimum and UNLIMITED_PAGES as their maximum.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if there is no such space, max_pages is 0 or below
+ * min_pages, or the minimums of all spaces do not fit in the RAM)
+ */
+int VMsetSpaceQuota(space_t space, uint64_t min_pages, uint64_t max_pages);
+
+/* Sets the share of the memory the given space gets under
+ * FAIR_REPLACEMENT, relative to the weights of the other spaces.
+ * New spaces have a weight of 1.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if there is no such space or the weight is 0)
+ */
+int VMsetSpaceWeight(space_t space, uint64_t weight);
+
+/* Chooses between GLOBAL_REPLACEMENT, the default, and FAIR_REPLACEMENT.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if the scope is neither of them)
+ */
+int VMsetReplacementScope(int scope);
+
 /* Reads a word from the given virtual address
  * and puts its content in *value.
  *
@@ -23,3 +107,89 @@ int VMread(uint64_t virtualAddress, word_t* value);
  * address for any reason)
  */
 int VMwrite(uint64_t virtualAddress, word_t value);
+
+/* Reads 'count' consecutive words starting at the given virtual address
+ * into values, translating every page in the range only once.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if any address in the range cannot be mapped to a
+ * physical address for any reason)
+ */
+int VMreadRange(uint64_t virtualAddress, word_t* values, uint64_t count);
+
+/* Writes 'count' consecutive words from values starting at the given
+ * virtual address, translating every page in the range only once.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if any address in the range cannot be mapped to a
+ * physical address for any reason)
+ */
+int VMwriteRange(uint64_t virtualAddress, const word_t* values,
+                 uint64_t count);
+
+/* Reads the word at addresses[i] into values[i] for every i < count.
+ * Addresses are grouped by page so every page is translated once.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if any of the addresses cannot be mapped to a
+ * physical address, in which case nothing is read)
+ */
+int VMgather(const uint64_t* addresses, word_t* values, uint64_t count);
+
+/* Writes values[i] to addresses[i] for every i < count. Addresses are
+ * grouped by page so every page is translated once, and writes to the same
+ * address keep their order.
+ *
+ * returns 1 on success.
+ * returns 0 on failure (if any of the addresses cannot be mapped to a
+ * physical address, in which case nothing is written)
+ */
+int VMscatter(const uint64_t* addresses, const word_t* values,
+              uint64_t count);
+
+/* Returns the number of translations that were served by the TLB
+ * since the last call to VMinitialize.
+ * With CONCURRENT_VM every thread has its own TLB, and the counts are
+ * those of the calling thread.
+ */
+uint64_t VMtlbHits();
+
+/* Returns the number of translations that missed the TLB and walked
+ * the page tables since the last call to VMinitialize.
+ * With CONCURRENT_VM every thread has its own TLB, and the counts are
+ * those of the calling thread.
+ */
+uint64_t VMtlbMisses();
+
+/* Returns the number of pages mapped ahead of their first access by the
+ * readahead of sequential and strided faults since the last call to
+ * VMinitialize.
+ */
+uint64_t VMreadaheadIssued();
+
+/* Returns how many of the pages mapped ahead were accessed before being
+ * evicted.
+ */
+uint64_t VMreadaheadUseful();
+
+/* Returns the number of pages of the given space that were brought into
+ * memory by an access since the last call to VMinitialize.
+ */
+uint64_t VMspacePageFaults(space_t space);
+
+/* Returns the number of pages of the given space that were evicted since
+ * the last call to VMinitialize.
+ */
+uint64_t VMspaceEvictions(space_t space);
+
+/* Returns the number of pages of the given space that are currently in
+ * memory.
+ */
+uint64_t VMspaceResidentPages(space_t space);
+
+/* Returns the number of frames the background reclaimer has freed ahead of
+ * the faults, which it keeps between RECLAIM_LOW_WATERMARK and
+ * RECLAIM_HIGH_WATERMARK once memory runs out. Always 0 without
+ * BACKGROUND_RECLAIM.
+ */
+uint64_t VMfreeFrames();